@@ -0,0 +1,340 @@
+
+// Diagnostics go to std::cerr; std::cout, if used, is for frames
+#define kip_cerr_is_not_cout
+#include "kip.h"
+
+// POSIX
+#include <cerrno>
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// kip: types
+using real  = double;
+using base  = kip::rgb;
+using color = kip::rgba;
+
+
+
+// -----------------------------------------------------------------------------
+// resident
+// One loaded model, with its own renderer, so that its bins, hierarchies,
+// and scratch space are kept from one request to the next. The scene's view,
+// light, engine, and image settings, as read from the file, are each
+// request's defaults.
+// -----------------------------------------------------------------------------
+
+class resident {
+public:
+   std::string file;
+   kip::scene<real,base,color> scene;
+   kip::renderer<real,base> renderer;
+   kip::image<real,color> image;
+};
+
+std::vector<std::unique_ptr<resident>> models;
+
+
+
+// -----------------------------------------------------------------------------
+// connection
+// A request stream and a reply stream: stdin and stdout, or a socket. Plain
+// file descriptors, so that both cases are read and written the same way.
+// -----------------------------------------------------------------------------
+
+class connection {
+   int in, out;
+   std::string buffer;
+
+public:
+   explicit connection(const int _in, const int _out) : in(_in), out(_out) { }
+
+   // getline
+   bool getline(std::string &line)
+   {
+      for (;;) {
+         const std::size_t n = buffer.find('\n');
+         if (n != std::string::npos) {
+            line = buffer.substr(0,n);
+            buffer.erase(0,n+1);
+            return true;
+         }
+         char chunk[4096];
+         const ssize_t got = ::read(in, chunk, sizeof(chunk));
+         if (got < 0 && errno == EINTR) continue;
+         if (got <= 0) {
+            // last line, without a newline
+            line = buffer;
+            buffer.clear();
+            return line != "";
+         }
+         buffer.append(chunk, std::size_t(got));
+      }
+   }
+
+   // put
+   bool put(const char *data, std::size_t n)
+   {
+      while (n) {
+         const ssize_t put = ::write(out, data, n);
+         if (put < 0 && errno == EINTR) continue;
+         if (put <= 0) return false;
+         data += put;  n -= std::size_t(put);
+      }
+      return true;
+   }
+   bool put(const std::string &str) { return put(str.data(), str.size()); }
+};
+
+
+
+// -----------------------------------------------------------------------------
+// render
+// Request:
+//    render [key=value ...]
+// where keys are:
+//    model    index of the model, in command-line order (default 0)
+//    size     HxV, in pixels (default: as the file says, or 800x800)
+//    format   ppm or raw (default ppm); raw is H*V RGB triples, top row first
+//    target   x,y,z
+//    d, fov, theta, phi, roll
+//    anti     antialiasing
+//    method   uniform, bvh, or block
+//    hzone, vzone
+// Reply:
+//    ok <nbytes>\n, followed by nbytes of frame; or
+//    error <message>\n
+// -----------------------------------------------------------------------------
+
+// reply_error
+bool reply_error(connection &c, const std::string &message)
+{
+   return c.put("error " + message + "\n");
+}
+
+// render
+bool render(connection &c, std::istringstream &request)
+{
+   ulong which = 0, hpixel = 0, vpixel = 0;
+   std::string format = "ppm";
+
+   // Look for the model first; its settings are the defaults
+   std::vector<std::pair<std::string,std::string>> setting;
+   for (std::string word;  request >> word; ) {
+      const std::size_t eq = word.find('=');
+      if (eq == std::string::npos)
+         return reply_error(c, "expected key=value, not \"" + word + "\"");
+      setting.push_back(std::make_pair(word.substr(0,eq), word.substr(eq+1)));
+      if (setting.back().first == "model")
+         which = std::strtoul(setting.back().second.c_str(), nullptr, 10);
+   }
+   if (which >= models.size())
+      return reply_error(c, "no such model");
+
+   resident &r = *models[which];
+   kip::view  <real> view   = r.scene.view  ();
+   kip::light <real> light  = r.scene.light ();
+   kip::engine<real> engine = r.scene.engine();
+   kip::image <real,color> &image = r.image;
+   image.background = r.scene.background;
+   image.aspect     = r.scene.aspect;
+   image.anti       = r.scene.anti;
+   image.border     = r.scene.border;
+   hpixel = r.scene.hpixel ? r.scene.hpixel : 800;
+   vpixel = r.scene.vpixel ? r.scene.vpixel : 800;
+
+   for (const auto &s : setting) {
+      const std::string &key = s.first;
+      std::istringstream value(s.second);
+      char x = 0, comma1 = ',', comma2 = ',';
+      bool okay = true;
+
+      if (key == "model") continue;
+      else if (key == "size"  ) okay = bool(value >> hpixel >> x >> vpixel);
+      else if (key == "format") format = s.second;
+      else if (key == "target")
+         okay = bool(value >> view.target.x >> comma1 >> view.target.y
+                           >> comma2 >> view.target.z);
+      else if (key == "d"    ) okay = bool(value >> view.d    );
+      else if (key == "fov"  ) okay = bool(value >> view.fov  );
+      else if (key == "theta") okay = bool(value >> view.theta);
+      else if (key == "phi"  ) okay = bool(value >> view.phi  );
+      else if (key == "roll" ) okay = bool(value >> view.roll );
+      else if (key == "anti" ) okay = bool(value >> image.anti);
+      else if (key == "hzone") okay = bool(value >> engine.hzone);
+      else if (key == "vzone") okay = bool(value >> engine.vzone);
+      else if (key == "method") {
+         if      (s.second == "uniform"  ) engine.method = kip::method::uniform;
+         else if (s.second == "bvh"      ) engine.method = kip::method::bvh;
+         else if (s.second == "block"    ) engine.method = kip::method::block;
+         else okay = false;
+      } else
+         return reply_error(c, "unknown key \"" + key + "\"");
+
+      if (!okay || (x && x != 'x') || comma1 != ',' || comma2 != ',')
+         return reply_error(c, "bad value for " + key);
+   }
+   // The recursive method isn't finished (it asserts), so we won't run it,
+   // even if the model file asks for it
+   if (engine.method == kip::method::recursive)
+      return reply_error(c, "method recursive isn't supported");
+   if (format != "ppm" && format != "raw")
+      return reply_error(c, "format must be ppm or raw");
+   if (hpixel == 0 || vpixel == 0 || hpixel*vpixel > 1ul << 28)
+      return reply_error(c, "bad size");
+
+   // light (moves w/viewer), as in kip.cc
+   light[0](view.target, view.d, view.theta+60, view.phi+10);
+
+   // trace
+   image.upsize(hpixel,vpixel);
+   if (!r.renderer.trace(r.scene.model(), view, light, engine, image))
+      return reply_error(c, "trace failed");
+
+   // encode
+   std::string frame;
+   if (format == "ppm") {
+      std::ostringstream oss;
+      kip::image_writer writer(oss, kip::image_format::ppm, hpixel, vpixel);
+      if (!writer.write(image) || !writer.finish())
+         return reply_error(c, "couldn't encode the frame");
+      frame = oss.str();
+   } else {
+      frame.reserve(3*hpixel*vpixel);
+      kip::image_writer writer(
+         [&frame, hpixel](const kip::uchar *const row, const ulong)
+         {
+            frame.append((const char *)row, 3*hpixel);
+            return true;
+         },
+         hpixel, vpixel
+      );
+      if (!writer.write(image) || !writer.finish())
+         return reply_error(c, "couldn't encode the frame");
+   }
+
+   std::ostringstream head;
+   head << "ok " << frame.size() << "\n";
+   return c.put(head.str()) && c.put(frame);
+}
+
+
+
+// -----------------------------------------------------------------------------
+// serve
+// Answers c's requests until it closes, or sends "quit". Returns false for
+// quit, so that the server stops.
+// -----------------------------------------------------------------------------
+
+bool serve(connection &c)
+{
+   for (std::string line;  c.getline(line); ) {
+      std::istringstream request(line);
+      std::string command;
+      if (!(request >> command)) continue;  // blank line
+
+      if (command == "quit")
+         return false;
+      else if (command == "render") {
+         if (!render(c, request)) break;  // peer went away
+      } else if (!reply_error(c, "unknown command \"" + command + "\""))
+         break;
+   }
+   return true;
+}
+
+
+
+// -----------------------------------------------------------------------------
+// listen_on
+// A Unix-domain socket at path; connections are answered one at a time, as
+// each frame already uses every thread.
+// -----------------------------------------------------------------------------
+
+int listen_on(const std::string &path)
+{
+   sockaddr_un addr;
+   std::memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+   if (path.size() >= sizeof(addr.sun_path)) {
+      std::cerr << "Socket path is too long: " << path << std::endl;
+      return -1;
+   }
+   std::strcpy(addr.sun_path, path.c_str());
+
+   const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+   ::unlink(path.c_str());
+   if (fd < 0 || ::bind(fd, (const sockaddr *)&addr, sizeof(addr)) != 0 ||
+       ::listen(fd, 8) != 0) {
+      std::cerr << "Couldn't listen on " << path << std::endl;
+      return -1;
+   }
+   return fd;
+}
+
+
+
+// -----------------------------------------------------------------------------
+// main
+// -----------------------------------------------------------------------------
+
+int main(const int argc, const char *const *const argv)
+{
+   // command-line arguments
+   std::string socket;
+   int a = 1;
+   if (a+1 < argc && std::string(argv[a]) == "-s")
+      socket = argv[a+1], a += 2;
+   if (a == argc) {
+      std::cerr << "Usage: " << argv[0] << " [-s socket] <file> ..."
+                << std::endl;
+      return 2;
+   }
+
+   // read the models, once
+   for ( ;  a < argc;  ++a) {
+      kip::istream infile(argv[a]);  // memory-mapped; see kip::istream
+      if (!infile) {
+         std::cerr << "Couldn't open " << argv[a] << std::endl;
+         return 1;
+      }
+      models.push_back(std::unique_ptr<resident>(new resident));
+      models.back()->file = argv[a];
+      // A read that hit errors recovers and goes on, so check those too;
+      // we won't serve a model that was only partly read
+      if (!(infile >> models.back()->scene) || infile.nerr) {
+         std::cerr << "Couldn't read " << argv[a] << std::endl;
+         return 1;
+      }
+      std::cerr << "Model " << models.size()-1 << ": " << argv[a]
+                << std::endl;
+   }
+
+   // a client that goes away shouldn't take us with it
+   std::signal(SIGPIPE, SIG_IGN);
+
+   // stdin/stdout
+   if (socket == "") {
+      connection c(0,1);
+      serve(c);
+      return 0;
+   }
+
+   // socket
+   const int fd = listen_on(socket);
+   if (fd < 0)
+      return 1;
+   for (bool more = true;  more; ) {
+      const int client = ::accept(fd, nullptr, nullptr);
+      if (client < 0) {
+         if (errno == EINTR) continue;
+         break;
+      }
+      connection c(client,client);
+      more = serve(c);
+      ::close(client);
+   }
+   ::close(fd);
+   ::unlink(socket.c_str());
+}
@@ -94,6 +94,12 @@ void initialize()
    engine.sort_min  = 64;
    engine.lean      = true;
 
+   // Trace every 8th pixel first, then every 4th, etc.; see render()
+   engine.progressive = 8;
+
+   // After a small turn or zoom, reuse what the last frame hit, where we can
+   engine.reproject = 3;
+
    // image
    image.background    = color(150,150,150);
    image.aspect        = 1.0;  // fixme Consider a/s for up/down
@@ -113,6 +119,8 @@ void initialize()
 // -----------------------------------------------------------------------------
 
 // render
+void putimage();
+
 void render()
 {
    if (vars::debug) {
@@ -150,8 +158,14 @@ void render()
       ;
 
    // trace
+   // With a window, show each of the progressive passes as it's finished;
+   // when timing, have just one pass, and trace every pixel
    if (vars::debug)
       std::cout << "trace()" << std::endl;
+   if (vars::timing)
+      engine.progressive = 0, engine.reproject = 0;
+   else
+      engine.progress = [](const unsigned) { putimage();  return true; };
    kip::trace(model, view, light, engine, image);
 }
 
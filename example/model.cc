@@ -17,4 +17,24 @@ int main()
    assert(model.size() == 3);  // Total number of objects
    model.clear();
    assert(model.size() == 0);
+
+   // A model that shares another's surf geometry (see model::share()) writes
+   // and reads back, in binary, like the original
+   kip::surf<> s;
+   s.push(kip::point<double>(0,0,0));
+   s.push(kip::point<double>(1,0,0));
+   s.push(kip::point<double>(0,1,0));
+   s.push(kip::surf<>::tri_t(0,1,2));
+   model.push(s);
+   kip::model<> shared;
+   shared.share(model);
+
+   std::ostringstream out;
+   assert(kip::write_binary(out, shared));
+   const std::string file = out.str();
+   kip::model<> in;
+   assert(kip::read_binary(file.data(), file.size(), in));
+   assert(in.surf.size() == 1);
+   assert(in.surf[0].node.size() == 3);
+   assert(in.surf[0].tri .size() == 1);
 }
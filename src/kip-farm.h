@@ -0,0 +1,399 @@
+
+// -----------------------------------------------------------------------------
+// Render farm
+// A frame is split into tiles, which are traced by worker processes and then
+// assembled. The workers are forked once, each loads its own model once, and
+// then serves tiles, over a socket, for as many frames as the farm lives. A
+// worker that dies takes nothing else down; its tile is handed to another.
+// POSIX only, and so opt-in: #define kip_farm before #including kip.h.
+// -----------------------------------------------------------------------------
+
+namespace detail {
+
+// farm_read, farm_write: all of n bytes, or false
+inline bool farm_read(const int fd, void *const data, const ulong n)
+{
+   for (ulong done = 0;  done < n; ) {
+      const ssize_t got = ::read(fd, (char *)data + done, n - done);
+      if (got > 0) done += ulong(got);
+      else if (got == 0 || errno != EINTR) return false;
+   }
+   return true;
+}
+
+inline bool farm_write(const int fd, const void *const data, const ulong n)
+{
+#ifdef MSG_NOSIGNAL
+   const int flags = MSG_NOSIGNAL;  // a dead peer isn't a SIGPIPE for us
+#else
+   const int flags = 0;
+#endif
+   for (ulong done = 0;  done < n; ) {
+      const ssize_t put =
+         ::send(fd, (const char *)data + done, n - done, flags);
+      if (put > 0) done += ulong(put);
+      else if (put == 0 || errno != EINTR) return false;
+   }
+   return true;
+}
+
+// farm_bound: the kth of n boundaries across npixel pixels, rounded as the
+// uniform method rounds its zones' bounds
+inline ulong farm_bound(const ulong npixel, const ulong k, const ulong n)
+{
+   return op::round<ulong>(double(npixel)*double(k)/double(n));
+}
+
+
+
+// -----------------------------------------------------------------------------
+// farm_job
+// What a worker is sent for each tile: the tile, and the view, light, engine,
+// and image settings with which to trace it. Plain data, so that it can be
+// sent as is. engine's progress, cancel, budget, reproject, and incremental,
+// and image's bitmap, are the coordinator's business, and aren't sent.
+// -----------------------------------------------------------------------------
+
+template<class real, class color>
+class farm_job {
+public:
+   // tile: pixels [i,i+hsize) x [j,j+vsize) of an hwhole x vwhole image
+   ulong hwhole, vwhole;
+   ulong i, j, hsize, vsize;
+
+   // view
+   point<real> target;
+   real d, fov, theta, phi, roll;
+
+   // light
+   point<real> light;
+
+   // engine
+   kip::method method;
+   unsigned hzone, vzone, hsub, vsub;
+   bool steal;
+   unsigned hdivision, vdivision, min_area;
+   unsigned leaf_size;
+   unsigned xzone, yzone, zzone;
+   real sort_frac;
+   unsigned sort_min;
+   bool lean;
+   real fudge;
+
+   // image
+   color background;
+   real aspect;
+   unsigned anti;
+   border_t border;
+   bool adaptive;
+   unsigned contrast;
+
+   // farm_job(); zeroed, so that padding isn't sent uninitialized
+   explicit farm_job() { std::memset((void *)this, 0, sizeof(farm_job)); }
+
+   // pack
+   void pack(
+      const kip::view  <real      > &v,
+      const kip::light <real      > &l,
+      const kip::engine<real      > &e,
+      const kip::image <real,color> &im
+   ) {
+      target = v.target;  d = v.d;  fov = v.fov;
+      theta = v.theta;  phi = v.phi;  roll = v.roll;
+
+      light = l[0];
+
+      method = e.method;
+      hzone = e.hzone;  hsub = e.hsub;  hdivision = e.hdivision;
+      vzone = e.vzone;  vsub = e.vsub;  vdivision = e.vdivision;
+      steal = e.steal;  min_area = e.min_area;  leaf_size = e.leaf_size;
+      xzone = e.xzone;  yzone = e.yzone;  zzone = e.zzone;
+      sort_frac = e.sort_frac;  sort_min = e.sort_min;
+      fudge = e.fudge;  lean = e.lean;
+
+      background = im.background;  aspect = im.aspect;
+      anti = im.anti;  border = im.border;
+      adaptive = im.adaptive;  contrast = im.contrast;
+   }
+
+   // unpack
+   void unpack(
+      kip::view  <real      > &v,
+      kip::light <real      > &l,
+      kip::engine<real      > &e,
+      kip::image <real,color> &im
+   ) const {
+      v.target = target;  v.d = d;  v.fov = fov;
+      v.theta = theta;  v.phi = phi;  v.roll = roll;
+
+      l[0] = light;
+
+      e.method = method;
+      e.hzone = hzone;  e.hsub = hsub;  e.hdivision = hdivision;
+      e.vzone = vzone;  e.vsub = vsub;  e.vdivision = vdivision;
+      e.steal = steal;  e.min_area = min_area;  e.leaf_size = leaf_size;
+      e.xzone = xzone;  e.yzone = yzone;  e.zzone = zzone;
+      e.sort_frac = sort_frac;  e.sort_min = sort_min;
+      e.fudge = fudge;  e.lean = lean;
+
+      im.background = background;  im.aspect = aspect;
+      im.anti = anti;  im.border = border;
+      im.adaptive = adaptive;  im.contrast = contrast;
+      im.upsize(hsize, vsize);
+   }
+};
+
+} // namespace detail
+
+
+
+// -----------------------------------------------------------------------------
+// farm
+// farm(nworker, load) forks nworker workers. Each calls load(model) to fill
+// in its own model, e.g. by reading a file, and, if that succeeds, waits for
+// tiles. Load models there, in the workers, not in this process beforehand.
+// OpenMP's threads don't survive a fork, and OpenMP is used not only by
+// tracing, but by reading a model file larger than parallel_read. So make
+// the farm before any OpenMP use in this process, including reading large
+// model files.
+//
+// trace(view, light, engine, image[, htile, vtile]) then traces image, at
+// its present size, as htile x vtile tiles, each by whichever worker is free,
+// and returns false if any tile couldn't be traced. A worker traces its tile
+// as trace_tiled() would; all of its threads are used, so nworker can be the
+// number of NUMA nodes, or sockets, rather than of cores. The default tiling
+// gives each worker about four tiles, for balance. engine.cancel is looked
+// at between tiles. The destructor closes the workers' sockets; they exit,
+// and are waited for.
+// -----------------------------------------------------------------------------
+
+template<
+   class real  = defaults::real,
+   class base  = defaults::base,
+   class color = defaults::color
+>
+class farm {
+   class worker_t {
+   public:
+      pid_t pid;
+      int fd;
+      bool alive;
+   };
+   std::vector<worker_t> worker;
+
+   // serve: a worker's life
+   template<class LOAD>
+   [[noreturn]] static void serve(const int fd, const LOAD &load)
+   {
+      model<real,base> m;
+      const char loaded = load(m);
+      if (!detail::farm_write(fd, &loaded, 1) || !loaded) ::_exit(1);
+
+      renderer<real,base> r;
+      view  <real> v;
+      light <real> l;
+      engine<real> e;
+      image <real,color> im;
+      detail::farm_job<real,color> job;
+
+      while (detail::farm_read(fd, &job, sizeof(job))) {
+         job.unpack(v, l, e, im);
+         const char okay = r.trace_window(
+            m, v, l, e, im, job.hwhole, job.vwhole, job.i, job.j);
+         if (!detail::farm_write(fd, &okay, 1) ||
+             (okay && !detail::farm_write(fd, im.bitmap.data(),
+                 job.hsize*job.vsize*sizeof(color))))
+            break;
+      }
+      ::_exit(0);
+   }
+
+   // lose: worker k, which has died or stopped answering
+   void lose(const ulong k)
+   {
+      worker_t &w = worker[k];
+      ::close(w.fd);
+      ::waitpid(w.pid, nullptr, 0);
+      w.alive = false;
+   }
+
+public:
+
+   // farm(nworker, load)
+   template<class LOAD>
+   explicit farm(const unsigned nworker, const LOAD &load)
+   {
+      static_assert(
+         std::is_trivially_copyable<color>::value,
+         "farm: pixels are sent as is, so color must be trivially copyable"
+      );
+
+      for (unsigned k = 0;  k < nworker;  ++k) {
+         int fd[2];
+         if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fd) != 0) {
+            (void)error("farm couldn't make a socket for a worker");
+            break;
+         }
+         std::cout.flush();  // else the worker inherits, and repeats, it
+         std::cerr.flush();
+         const pid_t pid = ::fork();
+         if (pid == 0) {
+            ::close(fd[0]);
+            for (const worker_t &w : worker) ::close(w.fd);
+            serve(fd[1], load);
+         }
+         ::close(fd[1]);
+         if (pid < 0) {
+            ::close(fd[0]);
+            (void)error("farm couldn't fork a worker");
+            break;
+         }
+         worker.push_back(worker_t{pid, fd[0], true});
+      }
+
+      // Wait for the models to be loaded
+      for (ulong k = 0;  k < worker.size();  ++k) {
+         char loaded = 0;
+         if (!detail::farm_read(worker[k].fd, &loaded, 1) || !loaded) {
+            std::ostringstream oss;
+            oss << "farm worker " << k << " couldn't load its model";
+            (void)warning(oss);
+            lose(k);
+         }
+      }
+   }
+
+   // destructor
+  ~farm()
+   {
+      for (ulong k = 0;  k < worker.size();  ++k)
+         if (worker[k].alive) lose(k);
+   }
+
+   farm(const farm &) = delete;
+   farm &operator=(const farm &) = delete;
+
+   // size: number of live workers
+   unsigned size() const
+   {
+      unsigned n = 0;
+      for (const worker_t &w : worker) n += w.alive;
+      return n;
+   }
+
+   // trace(view, light, engine, image[, htile, vtile])
+   bool trace(
+      const view  <real                  > &view,    // input
+      const light <real                  > &light,   // input
+      const engine<real                  > &engine,  // input
+            image <real,color> &image,   // input/output
+      unsigned htile = 0, unsigned vtile = 0
+   ) {
+      const ulong hpixel = image.hpixel, vpixel = image.vpixel;
+      if (htile == 0 || vtile == 0)
+         htile = vtile = unsigned(std::ceil(std::sqrt(4.0*size())));
+      htile = unsigned(op::min(ulong(op::max(htile,1u)), hpixel));
+      vtile = unsigned(op::min(ulong(op::max(vtile,1u)), vpixel));
+
+      detail::farm_job<real,color> job;
+      job.pack(view, light, engine, image);
+      job.hwhole = hpixel;
+      job.vwhole = vpixel;
+
+      // Tiles to do, and the tile each worker is doing, if busy
+      std::deque<rect> todo;
+      for (unsigned v = 0;  v < vtile;  ++v)
+      for (unsigned h = 0;  h < htile;  ++h)
+         todo.push_back(rect(
+            detail::farm_bound(hpixel, h, htile),
+            detail::farm_bound(hpixel, h+1, htile),
+            detail::farm_bound(vpixel, v, vtile),
+            detail::farm_bound(vpixel, v+1, vtile)
+         ));
+      std::vector<rect> tile(worker.size());
+      std::vector<bool> busy(worker.size(), false);
+      bool okay = true;
+
+      // give: worker k the next tile, if there is one
+      const auto give = [&](const ulong k)
+      {
+         if (!okay || todo.empty() || (engine.cancel && *engine.cancel))
+            return;
+         const rect &t = tile[k] = todo.front();
+         job.i = t.imin;  job.hsize = t.iend - t.imin;
+         job.j = t.jmin;  job.vsize = t.jend - t.jmin;
+         if (detail::farm_write(worker[k].fd, &job, sizeof(job)))
+            todo.pop_front(), busy[k] = true;
+         else
+            lose(k);
+      };
+
+      // take: worker k's tile, straight into image's rows
+      const auto take = [&](const ulong k)
+      {
+         const rect &t = tile[k];
+         busy[k] = false;
+         char traced = 0;
+         bool ok = detail::farm_read(worker[k].fd, &traced, 1);
+         for (ulong j = t.jmin;  ok && traced && j < t.jend;  ++j)
+            ok = detail::farm_read(worker[k].fd, &image(t.imin,j),
+                                   (t.iend - t.imin)*sizeof(color));
+         if (!ok) {
+            std::ostringstream oss;
+            oss << "farm lost worker " << k << " (pid " << worker[k].pid
+                << "); its tile will be given to another";
+            (void)warning(oss);
+            todo.push_front(t);
+            lose(k);
+         } else if (!traced)
+            okay = false;
+      };
+
+      for (ulong k = 0;  k < worker.size();  ++k)
+         if (worker[k].alive) give(k);
+
+      for (;;) {
+         std::vector<pollfd> wait;
+         std::vector<ulong> who;
+         for (ulong k = 0;  k < worker.size();  ++k)
+            if (busy[k]) {
+               wait.push_back(pollfd{worker[k].fd, POLLIN, 0});
+               who.push_back(k);
+            }
+         if (wait.empty()) break;
+
+         if (::poll(wait.data(), nfds_t(wait.size()), -1) < 0) {
+            if (errno == EINTR) continue;
+            (void)error("farm couldn't poll its workers");
+            // Drain the busy workers, waiting on each in turn, or their
+            // tiles would be read as the next trace's
+            okay = false;
+            for (const ulong k : who)
+               take(k);
+            return false;
+         }
+         for (ulong p = 0;  p < wait.size();  ++p)
+            if (wait[p].revents) {
+               take(who[p]);
+               // A tile may have come back from a lost worker
+               for (ulong k = 0;  k < worker.size();  ++k)
+                  if (worker[k].alive && !busy[k]) give(k);
+            }
+      }
+
+      if (okay && !todo.empty() && !(engine.cancel && *engine.cancel)) {
+         (void)error("farm has no workers left to trace with");
+         return false;
+      }
+      return okay && todo.empty();
+   }
+
+   // trace(scene[, htile, vtile])
+   // scene's own model is ignored; the workers have theirs
+   bool trace(
+      scene<real,base,color> &s,
+      const unsigned htile = 0, const unsigned vtile = 0
+   ) {
+      return trace(s, s, s, s, htile, vtile);
+   }
+};
@@ -0,0 +1,873 @@
+
+// -----------------------------------------------------------------------------
+// Binary model files
+// write_binary(file or std::ostream, model) writes a model in kip's binary
+// format; read_binary(file, model) reads one back, from a memory map of the
+// file where there's mmap. Much faster than text, for large models: there's
+// nothing to parse, and a surf's nodes, being stored just as they are in
+// memory, are copied straight out of the map.
+//
+// The format is a header, then, for each shape type (in kip_expand order), a
+// packed array of fixed-size records; then arrays of surf tris, of operand
+// references, and of the points in polygon, tabular, and surf tables. Each
+// type's array has the model's own shapes of that type first, then shapes
+// that are operators' operands. An operator refers to each of its operands
+// by type and index, rather than containing it, so that every record has a
+// fixed size. Numbers are written as they are in memory, so a file is read
+// only by the same real and base types, and the same byte order, with which
+// it was written. The header says which, and read_binary() checks.
+// -----------------------------------------------------------------------------
+
+namespace detail {
+
+// -----------------------------------------------------------------------------
+// binary_header
+// binary_section
+// binary_ref
+// -----------------------------------------------------------------------------
+
+class binary_header {
+public:
+   static constexpr u32 current = 1;  // version
+   static constexpr u32 order = 0x01020304;
+
+   char magic[8] = {'k','i','p','m','o','d','e','l'};
+   u32 version = current;
+   u32 endian = order;
+   u32 real_size = 0;
+   u32 base_size = 0;
+   u32 ulong_size = u32(sizeof(ulong));
+   u32 nsection = 0;
+};
+
+// binary_section
+// count records, each of size bytes; for shape types, the first top are the
+// model's own
+class binary_section {
+public:
+   u64 count = 0, top = 0, size = 0;
+};
+
+// binary_ref: shape index of shape type; type == none for a null operand
+class binary_ref {
+public:
+   static constexpr u64 none = ~u64(0);
+   u64 type = none, index = 0;
+};
+
+// binary_span: elements [first,first+count) of one of the arrays
+class binary_span {
+public:
+   u64 first = 0, count = 0;
+};
+
+// Sections, after the shape types
+enum binary_extra { binary_tri, binary_ref_pool, binary_point, binary_xr };
+constexpr ulong binary_nextra = 4;
+
+// binary_ntype
+#define kip_make_count(type) +1
+constexpr ulong binary_ntype = 0 kip_expand(kip_make_count,);
+#undef  kip_make_count
+
+// binary_pad: bytes to the next multiple of 8
+inline ulong binary_pad(const ulong n) { return (8 - n%8) % 8; }
+
+
+
+// -----------------------------------------------------------------------------
+// binary_common
+// binary_fields
+// What a shape's record holds, given to an io (see below), which sizes,
+// writes, or reads it. binary_common: what every shape has; binary_fields:
+// what's specific to the shape.
+// -----------------------------------------------------------------------------
+
+template<class IO, class real, class tag>
+inline void binary_common(IO &io, shape<real,tag> &obj)
+{
+   io.flags(obj);
+   io(obj.base());
+}
+
+template<class real, class tag>
+class binary_writer;
+
+// binary_geometry: the surf whose nodes and tris go in obj's record. When
+// writing, that's the one whose geometry obj uses; see surf::share().
+template<class IO, class real, class tag>
+inline surf<real,tag> &binary_geometry(IO &, surf<real,tag> &obj)
+{
+   return obj;
+}
+
+template<class real, class tag>
+inline const surf<real,tag> &binary_geometry(
+   binary_writer<real,tag> &, surf<real,tag> &obj
+) {
+   return obj.geometry();
+}
+
+#define kip_binary(type)\
+   template<class IO, class real, class tag>\
+   inline void binary_fields(IO &io, kip::type<real,tag> &obj)
+
+// operators
+kip_binary(kipnot) { io.operand(obj.unary.a); }
+kip_binary(kipand) { io.operand(obj.binary.a);  io.operand(obj.binary.b); }
+kip_binary(kipcut) { io.operand(obj.binary.a);  io.operand(obj.binary.b); }
+kip_binary(kipor ) { io.operand(obj.binary.a);  io.operand(obj.binary.b); }
+kip_binary(kipxor) { io.operand(obj.binary.a);  io.operand(obj.binary.b); }
+kip_binary(ands  ) { io.operands(obj.misc.ands); }
+kip_binary(odd   ) { io.operands(obj.nary); }
+kip_binary(even  ) { io.operands(obj.nary); }
+kip_binary(some  ) { io.operands(obj.nary); }
+kip_binary(one   ) { io.operands(obj.nary); }
+kip_binary(ors   ) { io.operands(obj.nary); }
+
+// shapes
+kip_binary(bicylinder) { io(obj.a);  io(obj.b);  io(obj.r); }
+kip_binary(biwasher  ) { io(obj.a);  io(obj.b);  io(obj.i);  io(obj.o); }
+kip_binary(box       ) { io(obj.c);  io(obj.a);  io(obj.r); }
+kip_binary(circle    ) { io(obj.c);  io(obj.n);  io(obj.r); }
+kip_binary(cone      ) { io(obj.a);  io(obj.b);  io(obj.r); }
+kip_binary(cylinder  ) { io(obj.a);  io(obj.b);  io(obj.r); }
+kip_binary(ellipsoid ) { io(obj.c);  io(obj.a);  io(obj.r); }
+kip_binary(half      ) { io(obj.point);  io(obj.normal); }
+kip_binary(paraboloid) { io(obj.a);  io(obj.b);  io(obj.r); }
+kip_binary(cube      ) { io(obj.c);  io(obj.a);  io(obj.r); }
+kip_binary(nothing   ) { (void)io;  (void)obj; }
+kip_binary(everything) { (void)io;  (void)obj; }
+kip_binary(pill      ) { io(obj.a);  io(obj.b);  io(obj.r); }
+kip_binary(polygon   ) { io.table(obj.table); }
+kip_binary(silo      ) { io(obj.a);  io(obj.b);  io(obj.r); }
+kip_binary(sphere    ) { io(obj.c);  io(obj.r); }
+kip_binary(spheroid  ) { io(obj.a);  io(obj.b);  io(obj.r); }
+kip_binary(tabular   ) { io(obj.a);  io(obj.b);  io.table(obj.table); }
+kip_binary(triangle  ) { io(obj.u);  io(obj.v);  io(obj.w); }
+kip_binary(washer    ) { io(obj.a);  io(obj.b);  io(obj.i);  io(obj.o); }
+kip_binary(xplane    ) { io(obj.x);  io(obj.size);  io(obj.color); }
+kip_binary(yplane    ) { io(obj.y);  io(obj.size);  io(obj.color); }
+kip_binary(zplane    ) { io(obj.z);  io(obj.size);  io(obj.color); }
+kip_binary(surf      ) {
+   auto &g = binary_geometry(io, obj);
+   io.table(g.node);  io.tris(g.tri);
+}
+kip_binary(tri       ) { io(obj.u);  io(obj.v);  io(obj.w); }
+
+#undef kip_binary
+
+// binary_record: common, then fields
+template<class IO, class SHAPE>
+inline void binary_record(IO &io, SHAPE &obj)
+{
+   binary_common(io, obj);
+   binary_fields(io, obj);
+}
+
+
+
+// -----------------------------------------------------------------------------
+// binary_size
+// An io that finds the size of a type's records
+// -----------------------------------------------------------------------------
+
+class binary_size {
+public:
+   u64 size = 0;
+
+   template<class T>
+   void operator()(const T &) { size += sizeof(T); }
+
+   template<class real, class tag>
+   void flags(const shape<real,tag> &) { size += 1; }
+
+   template<class real, class tag>
+   void operand(shape<real,tag> *const &) { size += sizeof(binary_ref); }
+
+   template<class NARY>
+   void operands(const NARY &) { size += sizeof(binary_span); }
+
+   template<class T>
+   void table(const std::vector<T> &) { size += sizeof(binary_span); }
+
+   template<class T>
+   void tris(const std::vector<T> &) { size += sizeof(binary_span); }
+};
+
+// binary_sizeof: of SHAPE's records
+template<class SHAPE>
+inline u64 binary_sizeof()
+{
+   static const u64 size = []()
+   {
+      SHAPE obj;
+      binary_size io;
+      binary_record(io, obj);
+      return io.size;
+   }();
+   return size;
+}
+
+
+
+// -----------------------------------------------------------------------------
+// binary_writer
+// An io that writes records into per-section buffers. Operands are queued,
+// each given the next index for its type, and written after the model's
+// own shapes; see write().
+// -----------------------------------------------------------------------------
+
+template<class real, class tag>
+class binary_writer {
+   using shape_t = shape<real,tag>;
+
+   // top: the model's own shapes; sub: operands
+   std::vector<char> top[binary_ntype], sub[binary_ntype];
+   u64 ntop[binary_ntype] = {}, nsub[binary_ntype] = {};
+   std::vector<char> trirec;
+   u64 ntri = 0;
+   std::vector<binary_ref> refs;
+   std::vector<point<real>> points;
+   std::vector<xrpoint<real>> xrpoints;
+
+   std::vector<char> *out = nullptr;  // buffer being written
+   std::deque<std::pair<u64, const shape_t *>> queue;
+
+   // type_of: kip_expand index of *ptr's type
+   static u64 type_of(const shape_t *const ptr)
+   {
+      u64 k = 0;
+   #define kip_make_type(type)\
+      if (ptr->id() == get_shape_id<kip::type>::result) return k; else ++k
+      kip_expand(kip_make_type,;)
+   #undef  kip_make_type
+      assert(false);
+      return k;
+   }
+
+   // put: raw bytes
+   void put(const void *const data, const ulong n)
+   {
+      out->insert(out->end(), (const char *)data, (const char *)data + n);
+   }
+
+   // record: *ptr, a shape of type k, into the current buffer
+   void record(const u64 k, const shape_t *const ptr)
+   {
+      u64 n = 0;
+   #define kip_make_record(type)\
+      if (k == n++)\
+         binary_record(*this, const_cast<kip::type<real,tag> &>(\
+            *static_cast<const kip::type<real,tag> *>(ptr)))
+      kip_expand(kip_make_record,;)
+   #undef  kip_make_record
+   }
+
+   // span: of n more elements in an array that has size elements
+   binary_span span(const u64 size, const u64 n)
+   {
+      binary_span s;
+      s.first = size - n;
+      s.count = n;
+      return s;
+   }
+
+public:
+
+   // ------------------------
+   // io
+   // ------------------------
+
+   template<class T>
+   void operator()(const T &value)
+   {
+      static_assert(std::is_trivially_copyable<T>::value,
+                    "binary model i/o needs trivially copyable data");
+      put(&value, sizeof(T));
+   }
+
+   void flags(const shape_t &obj)
+   {
+      const uchar f = uchar(
+         obj.eyelie | obj.on << 1 | obj.solid << 2 | obj.baseset << 3);
+      put(&f, 1);
+   }
+
+   // operand: queued, under the next index for its type
+   void operand(const shape_t *const ptr)
+   {
+      binary_ref r;
+      if (ptr) {
+         r.type = type_of(ptr);
+         r.index = ntop[r.type] + nsub[r.type]++;
+         queue.push_back(std::make_pair(r.type, ptr));
+      }
+      (*this)(r);
+   }
+
+   template<class NARY>
+   void operands(const NARY &nary)
+   {
+      const ulong n = nary.vec().size();
+      for (ulong i = 0;  i < n;  ++i) {
+         const shape_t *const ptr = nary.vec()[i].op;
+         binary_ref r;
+         if (ptr) {
+            r.type = type_of(ptr);
+            r.index = ntop[r.type] + nsub[r.type]++;
+            queue.push_back(std::make_pair(r.type, ptr));
+         }
+         refs.push_back(r);
+      }
+      (*this)(span(refs.size(), n));
+   }
+
+   void table(const std::vector<point<real>> &vec)
+   {
+      points.insert(points.end(), vec.begin(), vec.end());
+      (*this)(span(points.size(), vec.size()));
+   }
+
+   void table(const std::vector<xrpoint<real>> &vec)
+   {
+      xrpoints.insert(xrpoints.end(), vec.begin(), vec.end());
+      (*this)(span(xrpoints.size(), vec.size()));
+   }
+
+   template<class TRI>
+   void tris(const std::vector<TRI> &vec)
+   {
+      std::vector<char> *const save = out;
+      out = &trirec;
+      for (const TRI &t : vec)
+         binary_record(*this, const_cast<TRI &>(t));
+      out = save;
+      ntri += vec.size();
+      (*this)(span(ntri, vec.size()));
+   }
+
+   // ------------------------
+   // write
+   // ------------------------
+
+   bool write(std::ostream &s, const model<real,tag> &model);
+};
+
+
+
+// write
+template<class real, class tag>
+bool binary_writer<real,tag>::write(
+   std::ostream &s, const model<real,tag> &model
+) {
+   // Counts, so that operands' indices follow the model's own shapes
+   u64 k = 0;
+#define kip_make_count(type) ntop[k++] = model.type.size()
+   kip_expand(kip_make_count,;)
+#undef  kip_make_count
+
+   // The model's own shapes. The io functions don't modify anything, but
+   // binary_fields() takes non-const shapes, so as to serve for reading too.
+   k = 0;
+#define kip_make_top(type)\
+   out = &top[k++];\
+   for (const auto &obj : model.type)\
+      binary_record(*this, const_cast<kip::type<real,tag> &>(obj))
+   kip_expand(kip_make_top,;)
+#undef  kip_make_top
+
+   // Operands, and theirs, etc.
+   while (!queue.empty()) {
+      const std::pair<u64, const shape_t *> next = queue.front();
+      queue.pop_front();
+      out = &sub[next.first];
+      record(next.first, next.second);
+   }
+
+   // Header and sections
+   binary_header header;
+   header.real_size = u32(sizeof(real));
+   header.base_size = u32(sizeof(tag));
+   header.nsection = u32(binary_ntype + binary_nextra);
+
+   binary_section section[binary_ntype + binary_nextra];
+   k = 0;
+#define kip_make_section(type)\
+   section[k].count = ntop[k] + nsub[k];\
+   section[k].top = ntop[k];\
+   section[k].size = binary_sizeof<kip::type<real,tag>>();\
+   ++k
+   kip_expand(kip_make_section,;)
+#undef  kip_make_section
+
+   binary_section *const extra = section + binary_ntype;
+   extra[binary_tri].count = ntri;
+   extra[binary_tri].size = binary_sizeof<tri<real,tag>>();
+   extra[binary_ref_pool].count = refs.size();
+   extra[binary_ref_pool].size = sizeof(binary_ref);
+   extra[binary_point].count = points.size();
+   extra[binary_point].size = sizeof(point<real>);
+   extra[binary_xr].count = xrpoints.size();
+   extra[binary_xr].size = sizeof(xrpoint<real>);
+
+   // Each section is padded to a multiple of 8 bytes
+   const auto pad = [&s](const ulong n)
+   {
+      static const char zero[8] = {};
+      s.write(zero, std::streamsize(binary_pad(n)));
+   };
+   const auto write = [&s](const void *const data, const ulong n)
+   {
+      s.write((const char *)data, std::streamsize(n));
+   };
+
+   write(&header, sizeof(header));  pad(sizeof(header));
+   write(section, sizeof(section));  pad(sizeof(section));
+   for (k = 0;  k < binary_ntype;  ++k) {
+      write(top[k].data(), top[k].size());
+      write(sub[k].data(), sub[k].size());
+      pad(top[k].size() + sub[k].size());
+   }
+   write(trirec.data(), trirec.size());
+   pad(trirec.size());
+   write(refs.data(), refs.size()*sizeof(binary_ref));
+   write(points.data(), points.size()*sizeof(point<real>));
+   pad(points.size()*sizeof(point<real>));
+   write(xrpoints.data(), xrpoints.size()*sizeof(xrpoint<real>));
+   pad(xrpoints.size()*sizeof(xrpoint<real>));
+   return bool(s);
+}
+
+
+
+// -----------------------------------------------------------------------------
+// binary_unlink
+// An io that detaches operators from their operands, without deleting them;
+// for cleaning up after a bad file
+// -----------------------------------------------------------------------------
+
+class binary_unlink {
+public:
+   template<class T> void operator()(const T &) { }
+   template<class SHAPE> void flags(const SHAPE &) { }
+   template<class T> void table(const T &) { }
+   template<class T> void tris(const T &) { }
+
+   template<class real, class tag>
+   void operand(shape<real,tag> *&ptr) { ptr = nullptr; }
+
+   template<class NARY>
+   void operands(const NARY &nary) { nary.vec().clear(); }
+};
+
+
+
+// -----------------------------------------------------------------------------
+// binary_reader
+// An io that reads records from the file's sections. Operands are made
+// first, so that operators can be given pointers to them, then read. Every
+// operand must be some shape's operand exactly once, and must lead back to
+// one of the model's own shapes.
+// -----------------------------------------------------------------------------
+
+template<class real, class tag>
+class binary_reader {
+   using shape_t = shape<real,tag>;
+   static constexpr ulong nsection = binary_ntype + binary_nextra;
+   static constexpr u64 top_level = ~u64(0);
+
+   binary_section section[nsection];
+   const char *begin[nsection];  // each section's records
+
+   // operands, by type; each one's parent, as (type,index), once it's found
+   std::vector<shape_t *> sub[binary_ntype];
+   std::vector<std::pair<u64,u64>> parent[binary_ntype];
+
+   const char *in = nullptr;  // record being read
+   std::pair<u64,u64> self;   // its (type,index)
+   bool okay = true;
+
+   // get: raw bytes
+   void get(void *const data, const ulong n)
+   {
+      std::memcpy(data, in, n);
+      in += n;
+   }
+
+   // fail
+   bool fail(const std::string &what)
+   {
+      if (okay) {
+         std::ostringstream oss;
+         oss << "Bad binary model: " << what;
+         (void)error(oss);
+      }
+      return okay = false;
+   }
+
+   // at: record n of section k
+   const char *at(const ulong k, const u64 n) const
+   {
+      return begin[k] + n*section[k].size;
+   }
+
+   // spanned: is s within section k?
+   bool spanned(const binary_span &s, const ulong k)
+   {
+      return (s.first <= section[k].count &&
+              s.count <= section[k].count - s.first) ||
+         fail("span outside of its array");
+   }
+
+   // resolve: a reference to an operand
+   shape_t *resolve(const binary_ref &r)
+   {
+      if (r.type == binary_ref::none) return nullptr;
+      if (r.type >= binary_ntype ||
+          r.index < section[r.type].top || r.index >= section[r.type].count)
+         return fail("operand reference out of range"), nullptr;
+      const u64 n = r.index - section[r.type].top;
+      if (parent[r.type][n].first != top_level)  // top_level means none yet
+         return fail("operand used twice"), nullptr;
+      parent[r.type][n] = self;
+      return sub[r.type][n];
+   }
+
+   // each: f(SHAPE &) for operand n of type k
+   template<class FUN>
+   void each(const u64 k, const ulong n, const FUN &f)
+   {
+      u64 m = 0;
+   #define kip_make_each(type)\
+      if (k == m++) f(*(kip::type<real,tag> *)sub[k][n])
+      kip_expand(kip_make_each,;)
+   #undef  kip_make_each
+   }
+
+   bool rooted();
+   void unlink(model<real,tag> &, const ulong *const);
+
+public:
+
+   // ------------------------
+   // io
+   // ------------------------
+
+   template<class T>
+   void operator()(T &value) { get(&value, sizeof(T)); }
+
+   void flags(shape_t &obj)
+   {
+      uchar f;
+      get(&f, 1);
+      obj.eyelie  = f & 1;
+      obj.on      = f & 2;
+      obj.solid   = f & 4;
+      obj.baseset = f & 8;
+   }
+
+   void operand(shape_t *&ptr)
+   {
+      binary_ref r;
+      (*this)(r);
+      ptr = resolve(r);
+   }
+
+   template<class NARY>
+   void operands(const NARY &nary)
+   {
+      binary_span s;
+      (*this)(s);
+      if (!spanned(s, binary_ntype + binary_ref_pool)) return;
+      nary.vec().reserve(s.count);
+      for (u64 i = 0;  i < s.count;  ++i) {
+         binary_ref r;
+         std::memcpy(&r, at(binary_ntype + binary_ref_pool, s.first+i),
+                     sizeof(r));
+         nary.push().op = resolve(r);
+      }
+   }
+
+   template<class T>
+   void table(std::vector<T> &vec)
+   {
+      const ulong k = binary_ntype +
+         (std::is_same<T,point<real>>::value ? binary_point : binary_xr);
+      binary_span s;
+      (*this)(s);
+      if (!spanned(s, k)) return;
+      vec.resize(s.count);
+      if (s.count) std::memcpy(vec.data(), at(k, s.first), s.count*sizeof(T));
+   }
+
+   template<class TRI>
+   void tris(std::vector<TRI> &vec)
+   {
+      const ulong k = binary_ntype + binary_tri;
+      binary_span s;
+      (*this)(s);
+      if (!spanned(s, k)) return;
+      const char *const save = in;
+      vec.resize(s.count);
+      for (u64 i = 0;  i < s.count;  ++i) {
+         in = at(k, s.first+i);
+         binary_record(*this, vec[i]);
+      }
+      in = save;
+   }
+
+   // ------------------------
+   // read
+   // ------------------------
+
+   bool read(const char *const data, const ulong size, model<real,tag> &);
+};
+
+
+
+// rooted
+// Does every operand lead, through its parents, to one of the model's own
+// shapes? Operands in a cycle don't, as they'd otherwise never be deleted.
+template<class real, class tag>
+bool binary_reader<real,tag>::rooted()
+{
+   // 0: not yet known; 1: being followed; 2: rooted
+   std::vector<uchar> state[binary_ntype];
+   for (ulong k = 0;  k < binary_ntype;  ++k)
+      state[k].assign(sub[k].size(), 0);
+
+   std::vector<std::pair<u64,u64>> path;
+   for (ulong k = 0;  k < binary_ntype;  ++k)
+   for (ulong n = 0;  n < sub[k].size();  ++n) {
+      std::pair<u64,u64> at(k,n);
+      while (at.first != top_level && state[at.first][at.second] == 0) {
+         state[at.first][at.second] = 1;
+         path.push_back(at);
+         const std::pair<u64,u64> p = parent[at.first][at.second];
+         if (p.first == top_level)
+            at = p;
+         else if (p.second < section[p.first].top)
+            at.first = top_level;  // a model's own shape
+         else
+            at = std::make_pair(p.first, p.second - section[p.first].top);
+      }
+      if (at.first != top_level && state[at.first][at.second] == 1)
+         return false;  // a cycle
+      for (const std::pair<u64,u64> &q : path)
+         state[q.first][q.second] = 2;
+      path.clear();
+   }
+   return true;
+}
+
+
+
+// unlink
+// After a bad file: removes the shapes that were added to the model, and
+// deletes the operands, having first detached every operator from its
+// operands, so that nothing is deleted twice
+template<class real, class tag>
+void binary_reader<real,tag>::unlink(
+   model<real,tag> &model, const ulong *const old
+) {
+   binary_unlink io;
+   const auto detach = [&io](auto &obj) { binary_fields(io, obj); };
+
+   u64 k = 0;
+#define kip_make_unlink(type)\
+   for (ulong n = old[k];  n < model.type.size();  ++n)\
+      detach(model.type[n]);\
+   model.type.erase(model.type.begin() + long(old[k]), model.type.end());\
+   ++k
+   kip_expand(kip_make_unlink,;)
+#undef  kip_make_unlink
+
+   for (k = 0;  k < binary_ntype;  ++k)
+      for (ulong n = 0;  n < sub[k].size();  ++n)
+         each(k, n, detach);
+   for (k = 0;  k < binary_ntype;  ++k)
+      for (ulong n = 0;  n < sub[k].size();  ++n)
+         delete sub[k][n];
+}
+
+
+
+// read
+template<class real, class tag>
+bool binary_reader<real,tag>::read(
+   const char *const data, const ulong size, model<real,tag> &model
+) {
+   // header
+   binary_header header;
+   const ulong hsize = sizeof(header) + binary_pad(sizeof(header));
+   const ulong ssize = sizeof(section) + binary_pad(sizeof(section));
+   if (size < hsize + ssize)
+      return fail("file is too small");
+   std::memcpy(&header, data, sizeof(header));
+   std::memcpy(section, data + hsize, sizeof(section));
+
+   if (std::memcmp(header.magic, binary_header().magic, sizeof(header.magic)))
+      return fail("not a kip binary model file");
+   if (header.version != binary_header::current) {
+      std::ostringstream oss;
+      oss << "version " << header.version << "; expected version "
+          << binary_header::current;
+      return fail(oss.str());
+   }
+   if (header.endian != binary_header::order)
+      return fail("written on a machine with a different byte order");
+   if (header.real_size != sizeof(real) || header.base_size != sizeof(tag) ||
+       header.ulong_size != sizeof(ulong) || header.nsection != nsection)
+      return fail("written with different real, base, or kip types");
+
+   // sections
+   u64 k = 0;
+#define kip_make_check(type)\
+   if (section[k].size != binary_sizeof<kip::type<real,tag>>() ||\
+       section[k].top > section[k].count)\
+      return fail("bad section for " #type);\
+   ++k
+   kip_expand(kip_make_check,;)
+#undef  kip_make_check
+
+   const binary_section *const extra = section + binary_ntype;
+   if (extra[binary_tri].size != binary_sizeof<tri<real,tag>>() ||
+       extra[binary_ref_pool].size != sizeof(binary_ref) ||
+       extra[binary_point].size != sizeof(point<real>) ||
+       extra[binary_xr].size != sizeof(xrpoint<real>))
+      return fail("bad section for tri, operand, or table data");
+
+   ulong pos = hsize + ssize;
+   for (k = 0;  k < nsection;  ++k) {
+      if (section[k].size && section[k].count > (size-pos)/section[k].size)
+         return fail("file is truncated");
+      begin[k] = data + pos;
+      const ulong bytes = section[k].count*section[k].size;
+      pos += bytes + binary_pad(bytes);
+      if (pos > size)
+         return fail("file is truncated");
+   }
+
+   // make the operands
+   k = 0;
+#define kip_make_operands(type)\
+   for (u64 n = section[k].top;  n < section[k].count;  ++n)\
+      sub[k].push_back(new kip::type<real,tag>);\
+   parent[k].assign(sub[k].size(), std::make_pair(top_level, u64(0)));\
+   ++k
+   kip_expand(kip_make_operands,;)
+#undef  kip_make_operands
+
+   // read the model's own shapes
+   if (!model.append) model.clear();
+   ulong old[binary_ntype];
+   k = 0;
+#define kip_make_top(type)\
+   old[k] = model.type.size();\
+   model.type.reserve(old[k] + section[k].top);\
+   for (u64 n = 0;  n < section[k].top;  ++n) {\
+      model.type.emplace_back();\
+      in = at(k,n);  self = std::make_pair(k,n);\
+      binary_record(*this, model.type.back());\
+   }\
+   ++k
+   kip_expand(kip_make_top,;)
+#undef  kip_make_top
+
+   // read the operands
+   const auto record = [this](auto &obj) { binary_record(*this, obj); };
+   for (k = 0;  k < binary_ntype;  ++k)
+      for (ulong n = 0;  n < sub[k].size();  ++n) {
+         in = at(k, section[k].top + n);
+         self = std::make_pair(k, section[k].top + n);
+         each(k, n, record);
+      }
+
+   // every operand must have been used, and lead to the model's own shapes
+   for (k = 0;  k < binary_ntype && okay;  ++k)
+      for (ulong n = 0;  n < sub[k].size() && okay;  ++n)
+         if (parent[k][n].first == top_level)
+            fail("operand isn't used");
+   if (okay && !rooted())
+      fail("operands refer to one another in a cycle");
+
+   if (!okay) {
+      unlink(model, old);
+      return false;
+   }
+
+   ++model.revision;
+   model.changes.clear();
+   return true;
+}
+
+} // namespace detail
+
+
+
+// -----------------------------------------------------------------------------
+// write_binary
+// read_binary
+// -----------------------------------------------------------------------------
+
+// write_binary(std::ostream, model)
+template<class real, class base>
+bool write_binary(std::ostream &s, const model<real,base> &model)
+{
+   static_assert(std::is_trivially_copyable<base>::value,
+                 "write_binary: base must be trivially copyable");
+   detail::binary_writer<real,base> writer;
+   if (writer.write(s, model)) return true;
+   (void)error("Could not write binary model");
+   return false;
+}
+
+// write_binary(file name, model)
+template<class real, class base>
+bool write_binary(const std::string &name, const model<real,base> &model)
+{
+   std::ofstream s(name.c_str(), std::ios::binary);
+   if (!s) {
+      std::ostringstream oss;
+      oss << "Couldn't open \"" << name << "\" for writing";
+      (void)error(oss);
+      return false;
+   }
+   return write_binary(s, model);
+}
+
+// read_binary(data, size, model)
+// From memory, e.g. a file that the caller has mapped. Like reading a text
+// model, this replaces model's shapes unless model.append.
+template<class real, class base>
+bool read_binary(const void *const data, const ulong size, model<real,base> &m)
+{
+   static_assert(std::is_trivially_copyable<base>::value,
+                 "read_binary: base must be trivially copyable");
+   detail::binary_reader<real,base> reader;
+   return reader.read((const char *)data, size, m);
+}
+
+// read_binary(file name, model)
+// From a memory map of the file, or, if it can't be mapped, a copy of the
+// file read with std::ifstream
+template<class real, class base>
+bool read_binary(const std::string &name, model<real,base> &model)
+{
+   detail::mapped_file file;
+   if (file.open(name))
+      return read_binary(file.data, file.size, model);
+
+   std::ifstream s(name.c_str(), std::ios::binary);
+   if (!s) {
+      std::ostringstream oss;
+      oss << "Couldn't open \"" << name << '"';
+      (void)error(oss);
+      return false;
+   }
+   std::ostringstream copy;
+   copy << s.rdbuf();
+   const std::string str = copy.str();
+   return read_binary(str.data(), str.size(), model);
+}
@@ -277,6 +277,17 @@ bool read_color_component(
 
 
 
+// crayola_tables
+// Ensures that kip::crayola::allcolors is entirely initialized
+inline void crayola_tables()
+{
+   (void)kip::crayola::pure    ::table();
+   (void)kip::crayola::silver  ::table();
+   (void)kip::crayola::gem     ::table();
+   (void)kip::crayola::metallic::table();
+   (void)kip::crayola::complete::table();
+}
+
 // color2rgb
 template<class ISTREAM, class comp>
 bool color2rgb(
@@ -286,12 +297,7 @@ bool color2rgb(
    const std::string &sep,
    RGB<comp> &value
 ) {
-   // ensure that kip::crayola::allcolors is entirely initialized
-   (void)kip::crayola::pure    ::table();
-   (void)kip::crayola::silver  ::table();
-   (void)kip::crayola::gem     ::table();
-   (void)kip::crayola::metallic::table();
-   (void)kip::crayola::complete::table();
+   crayola_tables();
 
    // find; remember that the ordering is {color name, scope},
    // not the reverse, in allcolors' key.
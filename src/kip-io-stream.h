@@ -1,6 +1,81 @@
 
+// -----------------------------------------------------------------------------
+// mapped_file
+// A file, memory-mapped read-only, for kip::istream and read_binary(). Where
+// there's no mmap (see kip.h), open() always says no, and callers read the
+// file with std::ifstream instead.
+// -----------------------------------------------------------------------------
+
+namespace detail {
+
+class mapped_file {
+public:
+   const char *data = nullptr;
+   ulong size = 0;
+
+   // mapped_file()
+   explicit mapped_file() { }
+
+   // destructor
+  ~mapped_file()
+   {
+#ifdef kip_mmap
+      if (size) ::munmap(const_cast<char *>(data), size);
+#endif
+   }
+
+   mapped_file(const mapped_file &) = delete;
+   mapped_file &operator=(const mapped_file &) = delete;
+
+   // open
+   // False if the file isn't a regular file, or can't be mapped. An empty
+   // file can't be mapped, but, as there's nothing to map, it's opened.
+   bool open(const std::string &name)
+   {
+#ifdef kip_mmap
+      const int fd = ::open(name.c_str(), O_RDONLY);
+      if (fd < 0) return false;
+
+      struct stat info;
+      if (::fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+         ::close(fd);
+         return false;
+      }
+
+      const ulong n = ulong(info.st_size);
+      void *const addr =
+         n ? ::mmap(nullptr, n, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+      ::close(fd);
+      if (addr == MAP_FAILED) return false;
+      if (n) (void)::madvise(addr, n, MADV_SEQUENTIAL);
+
+      data = (const char *)addr;
+      size = n;
+      return true;
+#else
+      (void)name;
+      return false;
+#endif
+   }
+};
+
+} // namespace detail
+
+
+
 // -----------------------------------------------------------------------------
 // kip::istream
+// Given a file name, the file is memory-mapped, if it can be, and read in
+// place (if not, it's read through std::ifstream, as any other stream is):
+// characters are taken straight from memory, and numbers are parsed by
+// std::from_chars, rather than through std::istream's machinery. The
+// stream's state (good, eof, fail, bad) is kept as std::istream would keep
+// it, so that the reading functions, and diagnostics, behave as they do for
+// any other stream. So, for large files, prefer
+//    kip::istream k("file.kip");  k >> model;
+// to
+//    std::ifstream s("file.kip");  s >> model;
+// which is also slower, and whose diagnostics can't give line numbers.
 // -----------------------------------------------------------------------------
 
 class istream {
@@ -13,9 +88,18 @@ class istream {
    // Data
    // ------------------------
 
-   std::ifstream _stream;  // initialized iff this istream is file-based
+   std::ifstream _stream;  // initialized iff file-based, but not mapped
    std::istream  &stream;  //_stream or std::istream (constructor-dependent)
 
+   // iff mapped: the file is [data,data+size), we're at data+pos, and mstate
+   // stands in for stream's state
+   detail::mapped_file map;
+   bool mapped = false;
+   const char *data = nullptr;
+   ulong size = 0;
+   mutable ulong pos = 0;
+   mutable iostate mstate = std::ios::goodbit;
+
    // iff file-based...
    std::string file;   // file name
    unsigned    line;   // line number (1-indexed)
@@ -31,6 +115,7 @@ public:
 
 private:
    bool nice;  // true iff file-based
+   bool ispart = false;  // true iff a part of a file; see split()
 
 
 
@@ -42,19 +127,19 @@ public:
 
    // istream(char *)
    explicit istream(const char *const name)
- :_stream(name), stream(_stream),
+ : stream(_stream),
    file(name), line(1),
-   begin(tell()), themark(begin),
    level(0), maxerr(default_maxerr), nerr(0), bail(false), nice(true)
-   { }
+   {
+      if ((mapped = map.open(file)))
+         data = map.data, size = map.size;
+      else
+         _stream.open(name);
+      themark = begin = tell();
+   }
 
    // istream(std::string)
-   explicit istream(const std::string &name)
- :_stream(name.c_str()), stream(_stream),
-   file(name), line(1),
-   begin(tell()), themark(begin),
-   level(0), maxerr(default_maxerr), nerr(0), bail(false), nice(true)
-   { }
+   explicit istream(const std::string &name) : istream(name.c_str()) { }
 
    // istream(std::istream)
    explicit istream(std::istream &s)
@@ -63,6 +148,55 @@ public:
    level(0), maxerr(default_maxerr), nerr(0), bail(false), nice(false)
    { }
 
+   istream(const istream &) = delete;
+   istream &operator=(const istream &) = delete;
+
+
+
+   // ------------------------
+   // Parts, for reading a
+   // file in parallel
+   // ------------------------
+
+   // part: characters [first,last) of a mapped file, the first of which is
+   // on the given line
+   class part {
+   public:
+      ulong first, last;
+      unsigned line;
+   };
+
+   // split
+   // Cuts the rest of a mapped file into about n parts, by size. Each part
+   // but the last ends just after a ')' that closes a top-level '(', outside
+   // of any comment; so, if the file is a model, each part is a sequence of
+   // whole shapes. No parts if the stream isn't a mapped file, or isn't
+   // good, or is itself a part.
+   std::vector<part> split(const ulong n) const;
+
+   // istream(istream, part)
+   // A part, from whole.split(), as a stream of its own
+   explicit istream(const istream &whole, const part &p)
+ : stream(_stream),
+   mapped(true), data(whole.data), size(p.last), pos(p.first),
+   file(whole.file), line(p.line),
+   level(0), maxerr(whole.maxerr), nerr(0), bail(false), nice(whole.nice),
+   ispart(true)
+   {
+      ulong b = p.first;
+      while (b && data[b-1] != '\n') --b;
+      begin = streampos(std::streamoff(b));
+      themark = streampos(std::streamoff(p.first));
+   }
+
+   // resume: where p, this stream's last part, left off
+   void resume(const istream &p)
+   {
+      pos = p.pos;  mstate = p.mstate;
+      line = p.line;  begin = p.begin;  themark = p.themark;
+      level = p.level;
+   }
+
 
 
    // ------------------------
@@ -73,48 +207,75 @@ private:
    void newline() { line++;  begin = tell(); }
    void mark() { themark = tell(); }
 
+   // sentry: for mapped input, as std::istream::sentry; false, with failbit
+   // added, if the state isn't good. If skip, then skip whitespace, setting
+   // eofbit and failbit if there's nothing else.
+   bool sentry(const bool skip) const
+   {
+      if (mstate != std::ios::goodbit)
+         return mstate |= std::ios::failbit, false;
+      if (skip) {
+         while (pos < size && isspace(uchar(data[pos]))) ++pos;
+         if (pos == size)
+            return mstate |= std::ios::eofbit | std::ios::failbit, false;
+      }
+      return true;
+   }
+
+   // parse: a number, for mapped input, as stream >> value would
+   template<class T>
+   void parse(T &value) const;
+
 public:
    // stream-state stuff
-   bool bad () const { return stream.bad (); }
-   bool fail() const { return stream.fail(); }
-   bool eof () const { return stream.eof (); }
-   bool good() const { return stream.good(); }
+   bool bad () const { return state() & std::ios::badbit; }
+   bool fail() const { return state() & (std::ios::failbit|std::ios::badbit);}
+   bool eof () const { return state() & std::ios::eofbit; }
+   bool good() const { return state() == std::ios::goodbit; }
 
    // clear: clear all flags (equivalently, set state to good)
    void clear() const
    {
-      stream.clear();
+      set();
    }
 
    // set: make state equal to the given value
    void set(const iostate newstate = std::ios::goodbit) const
    {
-      stream.clear(newstate);
+      if (mapped) mstate = newstate; else stream.clear(newstate);
    }
 
    // add: logical-or the given value to the existing state
    void add(const iostate newstate) const
    {
-      stream.setstate(newstate);
+      if (mapped) mstate |= newstate; else stream.setstate(newstate);
    }
 
    // state: return the state
    iostate state() const
    {
-      return stream.rdstate();
+      return mapped ? mstate : stream.rdstate();
    }
 
    // seek: go to the given position
-   const istream &seek(const streampos pos) const
+   const istream &seek(const streampos to) const
    {
-      stream.seekg(pos);
+      if (!mapped)
+         stream.seekg(to);
+      else if (mstate &= ~std::ios::eofbit, sentry(false)) {
+         if (0 <= long(to) && ulong(long(to)) <= size)
+            pos = ulong(long(to));
+         else
+            mstate |= std::ios::failbit;
+      }
       return *this;
    }
 
    // tell: return the present position
    streampos tell() const
    {
-      return stream.tellg();
+      if (!mapped) return stream.tellg();
+      return sentry(false) ? streampos(std::streamoff(pos)) : streampos(-1);
    }
 
 
@@ -122,7 +283,10 @@ public:
    // input for char
    istream &input(char &value)
    {
-      stream >> value;
+      if (!mapped)
+         stream >> value;
+      else if (sentry(true))
+         value = data[pos++];
       if (value == '(') level++; else
       if (value == ')') level--;
       return *this;
@@ -132,18 +296,46 @@ public:
    template<class T>
    istream &input(T &value)
    {
-      stream >> value;
+      if (!mapped)
+         stream >> value;
+      else if (sentry(true))
+         parse(value);
       return *this;
    }
 
 
 
    // get, unget, peek, bool, !
-   int get() const { return stream.get(); }
-   const istream &unget() const { stream.unget();  return *this; }
-   int peek() { return stream.peek(); }
-   operator bool() const { return bool(stream); }
-   bool operator !() const { return !stream; }
+   int get() const
+   {
+      if (!mapped) return stream.get();
+      if (!sentry(false)) return EOF;
+      if (pos < size) return uchar(data[pos++]);
+      mstate |= std::ios::eofbit | std::ios::failbit;
+      return EOF;
+   }
+
+   const istream &unget() const
+   {
+      if (!mapped)
+         stream.unget();
+      else if (mstate &= ~std::ios::eofbit, sentry(false)) {
+         if (pos) --pos; else mstate |= std::ios::badbit;
+      }
+      return *this;
+   }
+
+   int peek()
+   {
+      if (!mapped) return stream.peek();
+      if (!sentry(false)) return EOF;
+      if (pos < size) return uchar(data[pos]);
+      mstate |= std::ios::eofbit;
+      return EOF;
+   }
+
+   operator bool() const { return !fail(); }
+   bool operator !() const { return fail(); }
 
 
 
@@ -255,6 +447,113 @@ public:
 
 
 
+// -----------------------------------------------------------------------------
+// parse
+// -----------------------------------------------------------------------------
+
+// parse
+// Like stream >> value: on failure, value is 0 and failbit is set, and eofbit
+// is set if the number reaches the end of the file. Unlike std::from_chars,
+// a leading '+' is allowed, as is '-' for unsigned types, which, as with
+// std::istream, negate the value in the unsigned type.
+template<class T>
+void istream::parse(T &value) const
+{
+   const char *const end = data + size;
+   const char *first = data + pos;
+
+   const bool minus = *first == '-';
+   if (*first == '+' || (minus && std::is_unsigned<T>::value)) ++first;
+
+   std::from_chars_result got;
+   if constexpr (
+      std::is_same<T,signed char>::value || std::is_same<T,unsigned char>::value
+   ) {
+      // as std::istream does, a character
+      value = T(data[pos++]);
+      return;
+   } else if constexpr (std::is_same<T,bool>::value) {
+      int n = 0;
+      got = std::from_chars(first, end, n);
+      if (got.ec == std::errc() && (n == 0 || n == 1))
+         value = n == 1;
+      else
+         got.ec = std::errc::invalid_argument;
+   } else if constexpr (std::is_floating_point<T>::value)
+      got = std::from_chars(first, end, value, std::chars_format::general);
+   else {
+      got = std::from_chars(first, end, value);
+      if (minus && std::is_unsigned<T>::value) value = T(-value);
+   }
+
+   if (got.ec != std::errc()) {
+      value = T(0);
+      mstate |= std::ios::failbit;
+      got.ptr = first;
+   }
+   pos = ulong(got.ptr - data);
+   if (pos == size) mstate |= std::ios::eofbit;
+}
+
+
+
+// -----------------------------------------------------------------------------
+// split
+// -----------------------------------------------------------------------------
+
+// Comments are recognized as prefix(), cline(), and cblock() recognize them,
+// including nested block comments.
+inline std::vector<istream::part> istream::split(const ulong n) const
+{
+   std::vector<part> parts;
+   if (!mapped || ispart || !good() || n < 2 || pos >= size)
+      return parts;
+
+   const ulong length = size - pos;
+   part p{pos, size, line};
+   unsigned l = line;
+   long depth = 0;
+
+   for (ulong i = pos;  i < size; ) {
+      const char ch = data[i++];
+      if (ch == '\n')
+         l++;
+      else if (ch == '(')
+         depth++;
+      else if (ch == ')') {
+         // top-level ')'; far enough along for a new part?
+         if (--depth == 0 &&
+             (i - p.first)*n >= length && size - i >= length/(2*n)) {
+            p.last = i;
+            parts.push_back(p);
+            p = part{i, size, l};
+         }
+      } else if (ch == '/' && i < size && data[i] == '/') {
+         // line comment
+         while (i < size && data[i] != '\n') ++i;
+      } else if (ch == '/' && i < size && data[i] == '*') {
+         // block comment, possibly nested
+         ulong nest = 1;
+         char last = data[i++];
+         while (nest && i < size) {
+            const char c = data[i++];
+            if (c == '\n')
+               l++;
+            else if (last == '/' && c == '*')
+               nest++;
+            else if (last == '*' && c == '/')
+               nest--;
+            last = c;
+         }
+      }
+   }
+
+   parts.push_back(p);
+   return parts;
+}
+
+
+
 // -----------------------------------------------------------------------------
 // context
 // -----------------------------------------------------------------------------
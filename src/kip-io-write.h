@@ -0,0 +1,233 @@
+
+// -----------------------------------------------------------------------------
+// Image output
+// -----------------------------------------------------------------------------
+
+// image_format
+// ppm: binary PPM (P6)
+// pam: PAM (P7), TUPLTYPE RGB
+// tga: uncompressed 24-bit truecolor TGA, top-left origin; at most 65535 x
+//      65535 pixels
+// Alpha isn't written; kip doesn't compute it.
+enum class image_format { ppm, pam, tga };
+
+
+
+// -----------------------------------------------------------------------------
+// image_writer
+// Writes an image, top row first, to a file or std::ostream, in one of the
+// above formats; or hands each row to an encoder, for formats that kip
+// doesn't know. Either write() a traced image, or give the image_writer to
+// trace_tiled() as its sink. As a sink, it gathers each band of tiles, then
+// writes the band from a background thread while trace_tiled() traces the
+// next; only two bands, not the image, are ever in memory. Call finish()
+// when done; it waits for the last band, and returns false if anything
+// went wrong, as do write() and the sink once something has.
+// -----------------------------------------------------------------------------
+
+class image_writer {
+public:
+   // encoder(row, j): row is hpixel RGB triples, and j counts from the top
+   using encoder_t = std::function<bool(const uchar *, ulong)>;
+
+private:
+   std::ofstream file;
+   std::ostream *out = nullptr;
+   encoder_t encoder;
+   image_format format = image_format::ppm;
+   ulong hpixel, vpixel;
+
+   // next: rows, from the top, that have been handed to emit()
+   ulong next = 0;
+   bool okay = true;
+   bool started = false;
+
+   // Bands: fill is being gathered from tiles; flush is being written
+   std::vector<uchar> fill, flush;
+   ulong filled = 0;  // pixels of fill that we have
+   std::future<bool> pending;
+
+   // header
+   bool header()
+   {
+      if (!out) return true;
+      if (format == image_format::tga) {
+         if (hpixel > 65535 || vpixel > 65535) {
+            std::ostringstream oss;
+            oss << "TGA can't be " << hpixel << " x " << vpixel << " pixels";
+            (void)error(oss);
+            return false;
+         }
+         const uchar h[18] = {
+            0, 0, 2,  0,0, 0,0, 0,  0,0, 0,0,
+            uchar(hpixel), uchar(hpixel >> 8),
+            uchar(vpixel), uchar(vpixel >> 8),
+            24, 0x20  // bits per pixel; top-left origin
+         };
+         out->write((const char *)h, sizeof(h));
+      } else if (format == image_format::pam)
+         *out << "P7\nWIDTH " << hpixel << "\nHEIGHT " << vpixel
+              << "\nDEPTH 3\nMAXVAL 255\nTUPLTYPE RGB\nENDHDR\n";
+      else
+         *out << "P6\n" << hpixel << ' ' << vpixel << "\n255\n";
+      return bool(*out);
+   }
+
+   // emit: rows [first,first+nrow), from the top, in data; for TGA, data
+   // become BGR
+   bool emit(uchar *data, const ulong first, const ulong nrow)
+   {
+      const ulong size = 3*hpixel;
+      for (ulong r = 0;  r < nrow;  ++r, data += size)
+         if (encoder) {
+            if (!encoder(data, first+r)) return false;
+         } else {
+            if (format == image_format::tga)
+               for (ulong n = 0;  n < size;  n += 3)
+                  std::swap(data[n], data[n+2]);
+            out->write((const char *)data, std::streamsize(size));
+         }
+      return encoder || bool(*out);
+   }
+
+   // wait: for the band being written, if any
+   bool wait()
+   {
+      if (pending.valid()) okay = pending.get() && okay;
+      return okay;
+   }
+
+   // start
+   bool start()
+   {
+      if (!started) started = true, okay = header() && okay;
+      return okay;
+   }
+
+   // put: a pixel, as RGB
+   template<class color>
+   static void put(uchar *const band, const color &c)
+   {
+      band[0] = uchar(c.r);
+      band[1] = uchar(c.g);
+      band[2] = uchar(c.b);
+   }
+
+public:
+
+   // image_writer(file name, format, hpixel, vpixel)
+   explicit image_writer(
+      const std::string &name, const image_format _format,
+      const ulong _hpixel, const ulong _vpixel
+   ) :
+      file(name.c_str(), std::ios::binary), out(&file), format(_format),
+      hpixel(_hpixel), vpixel(_vpixel)
+   {
+      if (!file) {
+         std::ostringstream oss;
+         oss << "Couldn't open \"" << name << "\" for writing";
+         (void)error(oss);
+         okay = false;
+      }
+   }
+
+   // image_writer(std::ostream, format, hpixel, vpixel)
+   explicit image_writer(
+      std::ostream &s, const image_format _format,
+      const ulong _hpixel, const ulong _vpixel
+   ) :
+      out(&s), format(_format), hpixel(_hpixel), vpixel(_vpixel)
+   { }
+
+   // image_writer(encoder, hpixel, vpixel)
+   explicit image_writer(
+      const encoder_t &_encoder, const ulong _hpixel, const ulong _vpixel
+   ) :
+      encoder(_encoder), hpixel(_hpixel), vpixel(_vpixel)
+   { }
+
+   // destructor
+  ~image_writer() { finish(); }
+
+   image_writer(const image_writer &) = delete;
+   image_writer &operator=(const image_writer &) = delete;
+
+   // write(image)
+   // The whole image, which must be hpixel x vpixel
+   template<class real, class color>
+   bool write(const image<real,color> &image)
+   {
+      if (image.hpixel != hpixel || image.vpixel != vpixel || next != 0) {
+         std::ostringstream oss;
+         oss << "image_writer expected a " << hpixel << " x " << vpixel
+             << " image, and nothing yet";
+         (void)error(oss);
+         return okay = false;
+      }
+      if (!start()) return false;
+
+      std::vector<uchar> row(3*hpixel);
+      for ( ;  okay && next < vpixel;  ++next) {
+         const ulong j = vpixel-1 - next;
+         for (ulong i = 0;  i < hpixel;  ++i)
+            put(&row[3*i], image(i,j));
+         okay = emit(row.data(), next, 1);
+      }
+      return okay;
+   }
+
+   // operator()(tile, i, j)
+   // As trace_tiled()'s sink. Tiles must come as trace_tiled() gives them:
+   // left to right in each band, and bands from the top of the image down.
+   template<class real, class color>
+   bool operator()(const image<real,color> &tile, const ulong i, const ulong j)
+   {
+      if (!start()) return false;
+
+      // The band's rows, from the top: [next, next+nrow)
+      const ulong nrow = tile.vpixel;
+      if (j+nrow != vpixel-next || i+tile.hpixel > hpixel ||
+          filled != i*nrow) {
+         std::ostringstream oss;
+         oss << "image_writer got an out-of-order tile, at (" << i << ','
+             << j << ')';
+         (void)error(oss);
+         return okay = false;
+      }
+
+      fill.resize(3*hpixel*nrow);
+      for (ulong v = 0;  v < nrow;  ++v) {
+         uchar *const row = &fill[3*(hpixel*(nrow-1-v) + i)];
+         for (ulong u = 0;  u < tile.hpixel;  ++u)
+            put(row + 3*u, tile(u,v));
+      }
+      filled += tile.hpixel*nrow;
+
+      // Band done? Write it while the next is traced
+      if (i+tile.hpixel == hpixel) {
+         if (!wait()) return false;
+         fill.swap(flush);
+         const ulong first = next;
+         pending = std::async(std::launch::async,
+            [this, first, nrow]() { return emit(flush.data(), first, nrow); });
+         next += nrow;
+         filled = 0;
+      }
+      return okay;
+   }
+
+   // finish
+   bool finish()
+   {
+      wait();
+      if (out) out->flush();
+      if (next != vpixel && okay) {
+         std::ostringstream oss;
+         oss << "image_writer got " << next << " of " << vpixel << " rows";
+         (void)error(oss);
+         okay = false;
+      }
+      next = vpixel;  // so that we complain only once
+      return okay && (!out || bool(*out));
+   }
+};
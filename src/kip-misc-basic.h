@@ -8,6 +8,7 @@
 using uchar = unsigned char;
 using ulong = std::size_t;
 using u32 = std::uint32_t;
+using u64 = std::uint64_t;
 
 // Default real type
 namespace defaults {
@@ -79,7 +80,8 @@ inline void print(const T &value)
 enum class method {
    uniform,
    recursive,
-   block
+   block,
+   bvh
 };
 
 namespace detail {
@@ -201,6 +203,12 @@ inline std::string tostring(const char *const         str) { return str; }
 inline std::string tostring(const std::string        &str) { return str; }
 inline std::string tostring(const std::ostringstream &oss) { return oss.str(); }
 
+// diagnostics_held
+// While non-null, diagprint(), in the thread that set it, counts diagnostics
+// here, rather than printing them. For threads that read parts of a model on
+// the calling thread's behalf; see read_value(model).
+inline thread_local ulong *diagnostics_held = nullptr;
+
 // diagprint: helper function
 template<class CONTEXT, class MESSAGE>
 void diagprint(
@@ -209,6 +217,11 @@ void diagprint(
 // static const char *const prefix = "    | ";  // possibly use this
    static const char *const prefix = "      ";
 
+   if (diagnostics_held) {
+      ++*diagnostics_held;
+      return;
+   }
+
    if (type[0]) {
       // introduction
       kip::cerr << "\n[kip] " << type;
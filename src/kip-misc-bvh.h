@@ -0,0 +1,317 @@
+// -----------------------------------------------------------------------------
+// Bounding volume hierarchy
+// Used by the bvh and block trace methods, and within surf
+// -----------------------------------------------------------------------------
+
+namespace detail {
+
+// -----------------------------------------------------------------------------
+// bvh_node
+// -----------------------------------------------------------------------------
+
+// Leaf if count != 0, with prims [first,first+count). Otherwise, the children
+// are at [this+1] and [first].
+template<class real>
+class bvh_node {
+public:
+   // Leaves are forced at this depth, bounding the traversal stack
+   static constexpr unsigned max_depth = 63;
+
+   point<real> min, max;
+   u32 first, count;
+
+   mutable u32 frame;  // bvh method: == bvh_t::frame iff not culled this frame
+};
+
+
+
+// -----------------------------------------------------------------------------
+// Helpers
+// -----------------------------------------------------------------------------
+
+// hcoord: x, y, or z
+template<class real>
+inline real hcoord(const point<real> &p, const unsigned axis)
+{
+   return axis == 0 ? p.x : axis == 1 ? p.y : p.z;
+}
+
+// hpad: pad a bounding box slightly, so that roundoff in the slab test can't
+// miss intersections that are right on the box
+template<class real>
+inline void hpad(point<real> &min, point<real> &max)
+{
+   static const real eps = std::sqrt(std::numeric_limits<real>::epsilon());
+   const real pad = eps*(
+      max.x - min.x + std::abs(min.x) + std::abs(max.x) +
+      max.y - min.y + std::abs(min.y) + std::abs(max.y) +
+      max.z - min.z + std::abs(min.z) + std::abs(max.z)
+   );
+   min.x -= pad;  min.y -= pad;  min.z -= pad;
+   max.x += pad;  max.y += pad;  max.z += pad;
+}
+
+// hslab: does the ray eyeball + t*dir, with inv = 1/dir, meet the box [min,max]
+// for some t in [0,qmin)? If so, tnear is where the ray enters the box.
+template<class real>
+inline bool hslab(
+   const point<real> &min, const point<real> &max,
+   const point<real> &eyeball, const point<real> &inv,
+   const real qmin, real &tnear
+) {
+   const real
+      ax = (min.x - eyeball.x)*inv.x, bx = (max.x - eyeball.x)*inv.x,
+      ay = (min.y - eyeball.y)*inv.y, by = (max.y - eyeball.y)*inv.y,
+      az = (min.z - eyeball.z)*inv.z, bz = (max.z - eyeball.z)*inv.z;
+
+   tnear = op::max(op::min(ax,bx), op::min(ay,by), op::min(az,bz));
+   const real tfar = op::min(op::max(ax,bx), op::max(ay,by), op::max(az,bz));
+
+   return tnear <= tfar && 0 <= tfar && tnear < qmin;
+}
+
+// hinverse: 1/dir, with tiny components replaced by (signed) tiny values, so
+// that we needn't rely on infinities (which -ffast-math wouldn't respect)
+template<class real>
+inline real hinverse(const real d)
+{
+   static const real tiny = std::sqrt(std::numeric_limits<real>::min());
+   return 1/(std::abs(d) >= tiny ? d : d < 0 ? -tiny : tiny);
+}
+
+// hdry: is the box [min,max] entirely on the dry side of seg? Only the corner
+// that's least dry (smallest dot with seg.matc) needs to be checked.
+template<class real>
+inline bool hdry(
+   const rotate<3,real,op::part,op::unscaled> &seg,
+   const point<real> &min, const point<real> &max
+) {
+   return seg.ge(point<real>(
+      seg.matc.x < 0 ? max.x : min.x,
+      seg.matc.y < 0 ? max.y : min.y,
+      seg.matc.z < 0 ? max.z : min.z
+   ));
+}
+
+
+// -----------------------------------------------------------------------------
+// hbuild
+// Splits by the surface area heuristic, evaluated at the boundaries of a few
+// equal-width bins along the longest axis of the prims' centers
+// -----------------------------------------------------------------------------
+
+// hbox: a box, and the number of prims in it
+template<class real>
+class hbox {
+public:
+   point<real> min, max;
+   u32 count;
+
+   explicit hbox() :
+      min( std::numeric_limits<real>::max(),
+           std::numeric_limits<real>::max(),
+           std::numeric_limits<real>::max()),
+      max(-std::numeric_limits<real>::max(),
+          -std::numeric_limits<real>::max(),
+          -std::numeric_limits<real>::max()),
+      count(0)
+   { }
+
+   // grow, to enclose [a,b]
+   void grow(const point<real> &a, const point<real> &b)
+   {
+      min(op::min(min.x,a.x), op::min(min.y,a.y), op::min(min.z,a.z));
+      max(op::max(max.x,b.x), op::max(max.y,b.y), op::max(max.z,b.z));
+   }
+
+   // area; any constant factor will do
+   real area() const
+   {
+      if (count == 0) return 0;
+      const point<real> e = max - min;
+      return e.x*e.y + e.y*e.z + e.z*e.x;
+   }
+};
+
+// hbin: which of nbin bins is the prim's center in?
+template<class real, class PRIM>
+class hbin {
+   const unsigned axis;
+   const real cmin, fac;
+public:
+   static constexpr unsigned nbin = 16;
+
+   explicit hbin(const unsigned _axis, const real _cmin, const real cmax) :
+      axis(_axis), cmin(_cmin), fac(real(nbin)*(1-real(1e-6))/(cmax-_cmin))
+   { }
+
+   unsigned operator()(const PRIM &p) const
+   {
+      const real c = hcoord(p.min,axis) + hcoord(p.max,axis);  // doubled
+      return op::min(nbin-1, unsigned(op::max(real(0), (c-cmin)*fac)));
+   }
+};
+
+// hbin_less: for std::partition
+template<class real, class PRIM>
+class hbin_less {
+   const hbin<real,PRIM> &bin;
+   const unsigned split;
+public:
+   explicit hbin_less(const hbin<real,PRIM> &_bin, const unsigned _split) :
+      bin(_bin), split(_split)
+   { }
+   bool operator()(const PRIM &p) const
+      { return bin(p) < split; }
+};
+
+// hbuild
+// Builds the subtree for prim[first,first+count), reordering those prims, and
+// returns the index of its root in node. PRIM needs only min and max.
+template<class real, class PRIM>
+u32 hbuild(
+   std::vector<PRIM> &prim, std::vector<bvh_node<real>> &node,
+   const u32 first, const u32 count,
+   const unsigned leaf_size, const unsigned depth = 0
+) {
+   const u32 index = u32(node.size());
+   node.push_back(bvh_node<real>());
+
+   // bounds of the prims, and of their centers (doubled; just compare)
+   hbox<real> box, center;
+   for (u32 n = first;  n < first+count;  ++n) {
+      const PRIM &p = prim[n];
+      const point<real> c = p.min + p.max;
+      box.grow(p.min, p.max);
+      center.grow(c,c);
+   }
+
+   node[index].min = box.min;
+   node[index].max = box.max;
+   node[index].frame = 0;
+
+   // split axis
+   const point<real> extent = center.max - center.min;
+   const unsigned axis =
+      extent.x >= extent.y && extent.x >= extent.z ? 0
+    : extent.y >= extent.z ? 1 : 2;
+
+   // leaf?
+   if (count <= leaf_size || !(hcoord(extent,axis) > 0) ||
+       depth == bvh_node<real>::max_depth) {
+      node[index].first = first;
+      node[index].count = count;
+      return index;
+   }
+
+   // bin the prims
+   const unsigned nbin = hbin<real,PRIM>::nbin;
+   const hbin<real,PRIM> bin(
+      axis, hcoord(center.min,axis), hcoord(center.max,axis));
+   hbox<real> bins[nbin];
+   for (u32 n = first;  n < first+count;  ++n) {
+      const PRIM &p = prim[n];
+      hbox<real> &b = bins[bin(p)];
+      b.grow(p.min, p.max);
+      b.count++;
+   }
+
+   // area of what's left of each bin boundary...
+   real left[nbin];
+   hbox<real> sweep;
+   for (unsigned b = 0;  b < nbin-1;  ++b) {
+      sweep.grow(bins[b].min, bins[b].max);
+      sweep.count += bins[b].count;
+      left[b] = sweep.area()*real(sweep.count);
+   }
+
+   // ...and of what's right, for the cheapest boundary
+   unsigned split = nbin/2;
+   real cost = std::numeric_limits<real>::max();
+   sweep = hbox<real>();
+   for (unsigned b = nbin-1;  b > 0;  --b) {
+      sweep.grow(bins[b].min, bins[b].max);
+      sweep.count += bins[b].count;
+      const real c = left[b-1] + sweep.area()*real(sweep.count);
+      if (c < cost) cost = c, split = b;
+   }
+
+   // split; left child follows immediately
+   using diff_t = typename std::vector<PRIM>::difference_type;
+   const u32 mid = u32(std::partition(
+      prim.begin() + diff_t(first),
+      prim.begin() + diff_t(first+count),
+      hbin_less<real,PRIM>(bin,split)
+   ) - prim.begin());
+   kip_assert(first < mid && mid < first+count);
+
+   hbuild(prim, node, first, mid-first, leaf_size, depth+1);
+   const u32 right =
+      hbuild(prim, node, mid, first+count-mid, leaf_size, depth+1);
+
+   node[index].first = right;
+   node[index].count = 0;
+   return index;
+}
+
+
+
+// -----------------------------------------------------------------------------
+// hwalk
+// Walks the hierarchy along the ray eyeball + t*dir, where inv = 1/dir, nearer
+// child first, calling visit(leaf,qmin) for each leaf that the ray meets for
+// some t in [0,qmin). visit may reduce qmin as it goes. Nodes for which
+// visit.skip(node) is true are ignored, along with their descendants.
+// -----------------------------------------------------------------------------
+
+template<class real, class VISIT>
+void hwalk(
+   const std::vector<bvh_node<real>> &node,
+   const point<real> &eyeball, const point<real> &inv,
+   real &qmin, VISIT &visit
+) {
+   if (node.size() == 0 || visit.skip(node[0])) return;
+
+   // stack of nodes, and where the ray enters them; see max_depth
+   u32  snode[bvh_node<real>::max_depth+1];
+   real snear[bvh_node<real>::max_depth+1];
+   unsigned size = 0;
+   real tnear;
+
+   if (hslab(node[0].min, node[0].max, eyeball, inv, qmin, tnear))
+      snode[size] = 0, snear[size++] = tnear;
+
+   while (size) {
+      const u32 index = snode[--size];
+      if (!(snear[size] < qmin)) continue;
+      const bvh_node<real> &n = node[index];
+
+      if (n.count) {
+         visit(n, qmin);
+         continue;
+      }
+
+      // children; push the farther one first, so that the nearer one is
+      // examined first
+      const bvh_node<real> &l = node[index+1], &r = node[n.first];
+      real tl, tr;
+      const bool
+         hl = !visit.skip(l) && hslab(l.min, l.max, eyeball, inv, qmin, tl),
+         hr = !visit.skip(r) && hslab(r.min, r.max, eyeball, inv, qmin, tr);
+
+      if (hl && hr) {
+         if (tl < tr) {
+            snode[size] = n.first, snear[size++] = tr;
+            snode[size] = index+1, snear[size++] = tl;
+         } else {
+            snode[size] = index+1, snear[size++] = tl;
+            snode[size] = n.first, snear[size++] = tr;
+         }
+      } else if (hl)
+         snode[size] = index+1, snear[size++] = tl;
+      else if (hr)
+         snode[size] = n.first, snear[size++] = tr;
+   }
+}
+
+} // namespace detail
@@ -0,0 +1,282 @@
+
+// -----------------------------------------------------------------------------
+// shape_pool
+// Memory for shapes that are made with new: operators' operands, mostly, as
+// made by reading, by copying an operator, or by the user. Each thread cuts
+// blocks, one after another, from large chunks; so an operand tree that's
+// read or copied in one go, which allocates as it goes depth-first, is laid
+// out contiguously, in the order in which op_first() and op_all() visit it.
+// Freed blocks go on the freeing thread's list for their size, to be reused.
+// A list that grows past cap blocks gives half of them to the pool, where any
+// thread that runs out takes a batch of them before it cuts a new chunk; so
+// blocks freed by one thread, e.g. the operands that other threads read in
+// parallel (see read_parallel), aren't stranded there. A thread that exits
+// gives its lists to the pool. The chunks themselves are kept until the
+// program ends, so shapes in static objects can be deleted at any point
+// during exit.
+//
+// Define kip_no_shape_pool to use plain new and delete instead, e.g. so that
+// a memory checker sees each shape.
+// -----------------------------------------------------------------------------
+
+namespace detail {
+
+class shape_pool {
+public:
+   static constexpr ulong align = alignof(std::max_align_t);
+   static constexpr ulong nclass = 32;  // block sizes up to nclass*align
+   static constexpr ulong chunk_size = 1ul << 16;
+   static constexpr ulong cap = 1024;  // blocks in a thread's list, per size
+
+private:
+   class block {
+   public:
+      block *next;
+   };
+
+   // global: chunks, and blocks that threads gave up
+   class global {
+   public:
+      std::mutex mutex;
+      std::vector<void *> chunk;
+      block *spare[nclass] = {};
+   };
+
+   // local: a thread's current chunk, and its freed blocks. Trivially
+   // destructible, so that it's usable even as the thread exits.
+   class local {
+   public:
+      char *next = nullptr, *end = nullptr;
+      block *free[nclass] = {};
+      ulong nfree[nclass] = {};
+      bool enlisted = false;
+   };
+
+   // retire: on thread exit, gives the thread's freed blocks to the pool
+   class retire {
+   public:
+     ~retire();
+   };
+
+   // The pool is never destroyed; see above
+   static global &pool()
+   {
+      static global *const g = new global;
+      return *g;
+   }
+
+   static local &here()
+   {
+      static thread_local local l;
+      return l;
+   }
+
+   static void enlist()
+   {
+      static thread_local retire r;
+      (void)r;
+      here().enlisted = true;
+   }
+
+   static void *refill(const ulong c);
+   static void spill(const ulong c);
+
+public:
+
+   // allocate
+   static void *allocate(const ulong size)
+   {
+      const ulong c = size ? (size-1)/align : 0;
+      if (c >= nclass) return ::operator new(size);
+
+      local &l = here();
+      if (block *const b = l.free[c]) {
+         l.free[c] = b->next;
+         --l.nfree[c];
+         return b;
+      }
+      const ulong n = (c+1)*align;
+      if (ulong(l.end - l.next) >= n) {
+         void *const ptr = l.next;
+         l.next += n;
+         return ptr;
+      }
+      return refill(c);
+   }
+
+   // allocate, nothrow
+   // From the heap, not a chunk, but rounded up to the size's class, so that
+   // deallocate() can take it like any other block. nullptr if out of memory.
+   static void *allocate(const ulong size, const std::nothrow_t &nothrow)
+   {
+      const ulong c = size ? (size-1)/align : 0;
+      return ::operator new(c < nclass ? (c+1)*align : size, nothrow);
+   }
+
+   // deallocate
+   static void deallocate(void *const ptr, const ulong size)
+   {
+      if (!ptr) return;
+      const ulong c = size ? (size-1)/align : 0;
+      if (c >= nclass) {
+         ::operator delete(ptr);
+         return;
+      }
+
+      local &l = here();
+      if (!l.enlisted) enlist();
+      block *const b = (block *)ptr;
+      b->next = l.free[c];
+      l.free[c] = b;
+      if (++l.nfree[c] > cap) spill(c);
+   }
+};
+
+
+
+// refill
+// For a block of class c, when the thread has none free, and its chunk is
+// used up: a spare block, along with up to cap/2 more for the thread's list,
+// if there are any; else a new chunk
+inline void *shape_pool::refill(const ulong c)
+{
+   local &l = here();
+   if (!l.enlisted) enlist();
+   global &g = pool();
+   const std::lock_guard<std::mutex> lock(g.mutex);
+
+   if (block *const b = g.spare[c]) {
+      g.spare[c] = b->next;
+      for (ulong n = cap/2;  n && g.spare[c];  --n) {
+         block *const s = g.spare[c];
+         g.spare[c] = s->next;
+         s->next = l.free[c];
+         l.free[c] = s;
+         ++l.nfree[c];
+      }
+      return b;
+   }
+
+   char *const chunk = (char *)::operator new(chunk_size);
+   g.chunk.push_back(chunk);
+   l.next = chunk + (c+1)*align;
+   l.end = chunk + chunk_size;
+   return chunk;
+}
+
+// spill
+// The thread's list of blocks of class c is too long: give half to the pool
+inline void shape_pool::spill(const ulong c)
+{
+   local &l = here();
+   global &g = pool();
+   const std::lock_guard<std::mutex> lock(g.mutex);
+
+   for (ulong n = cap/2;  n--; ) {
+      block *const b = l.free[c];
+      l.free[c] = b->next;
+      b->next = g.spare[c];
+      g.spare[c] = b;
+   }
+   l.nfree[c] -= cap/2;
+}
+
+// ~retire
+inline shape_pool::retire::~retire()
+{
+   local &l = here();
+   global &g = pool();
+   const std::lock_guard<std::mutex> lock(g.mutex);
+
+   for (ulong c = 0;  c < nclass;  ++c) {
+      while (block *const b = l.free[c]) {
+         l.free[c] = b->next;
+         b->next = g.spare[c];
+         g.spare[c] = b;
+      }
+      l.nfree[c] = 0;
+   }
+   l.next = l.end = nullptr;
+}
+
+
+
+// -----------------------------------------------------------------------------
+// afew_arena
+// Memory for afews that outgrow their own buffers. Each thread cuts blocks,
+// one after another, from its own chunks, and never frees them one by one;
+// the trace resets the arena before each pixel, and the chunks are reused.
+// A reset begins a new epoch; storage from an earlier epoch is no longer
+// its afew's, which afew checks before filling itself anew. Between resets,
+// at most limit bytes come from the arena, after which allocate() returns
+// nullptr and the afew uses the heap, as it would outside of a trace, where
+// nothing resets the arena.
+// -----------------------------------------------------------------------------
+
+class afew_arena {
+public:
+   static constexpr ulong align = alignof(std::max_align_t);
+   static constexpr ulong chunk_size = 1ul << 16;
+   static constexpr ulong limit = 1ul << 24;
+
+private:
+   class local {
+   public:
+      std::vector<std::unique_ptr<char[]>> chunk;
+      ulong current = 0;  // chunk being cut
+      char *next = nullptr, *end = nullptr;
+      ulong epoch = 1;  // never 0; see afew
+      bool used = false;
+   };
+
+   static local &here()
+   {
+      static thread_local local l;
+      return l;
+   }
+
+public:
+
+   // epoch
+   static ulong epoch() { return here().epoch; }
+
+   // allocate
+   // size bytes, or nullptr for the heap; epoch is set to the current epoch
+   static void *allocate(const ulong size, ulong &epoch)
+   {
+      const ulong n = (size + align-1)/align*align;
+      if (n > chunk_size) return nullptr;
+
+      local &l = here();
+      if (ulong(l.end - l.next) < n) {
+         const ulong c = l.next ? l.current+1 : 0;
+         if (c*chunk_size >= limit) return nullptr;
+         if (c == l.chunk.size())
+            l.chunk.push_back(std::unique_ptr<char[]>(new char[chunk_size]));
+         l.current = c;
+         l.next = l.chunk[c].get();
+         l.end  = l.next + chunk_size;
+      }
+
+      void *const ptr = l.next;
+      l.next += n;
+      l.used = true;
+      epoch = l.epoch;
+      return ptr;
+   }
+
+   // reset
+   // All of the thread's arena storage is free again
+   static void reset()
+   {
+      local &l = here();
+      if (!l.used) return;
+      l.used = false;
+      ++l.epoch;
+      l.current = 0;
+      l.next = l.chunk[0].get();
+      l.end  = l.next + chunk_size;
+   }
+};
+
+} // namespace detail
@@ -0,0 +1,117 @@
+// -----------------------------------------------------------------------------
+// Work stealing
+// Used by the uniform method, whose bins can differ in cost by many orders of
+// magnitude, to keep every thread busy until the last bin is done
+// -----------------------------------------------------------------------------
+
+namespace detail {
+
+// -----------------------------------------------------------------------------
+// steal_queue
+// One double-ended queue of tasks per thread. A thread takes tasks from the
+// front of its own queue and, when that's empty, from the back of the others'
+// queues. A task may push() more tasks, e.g. pieces of itself, while it runs.
+// -----------------------------------------------------------------------------
+
+template<class TASK>
+class steal_queue {
+   class deque_t {
+   public:
+      std::mutex mutex;
+      std::deque<TASK> task;
+   };
+
+   std::vector<deque_t> queue;
+   std::atomic<ulong> pending;   // pushed, but not finished
+   std::atomic<ulong> pushed;    // ever pushed
+   std::atomic<unsigned> idle;   // threads that are looking for work
+
+   // A thread that finds nothing to take yields spin times, then sleeps until
+   // something is pushed, or everything is finished
+   static constexpr unsigned spin = 64;
+   std::mutex park;
+   std::condition_variable wakeup;
+
+   // wake: the sleeping threads, if any
+   void wake()
+   {
+      { const std::lock_guard<std::mutex> lock(park); }
+      wakeup.notify_all();
+   }
+
+   // take
+   bool take(const unsigned q, TASK &task)
+   {
+      const unsigned n = size();
+      for (unsigned k = 0;  k < n;  ++k) {
+         deque_t &d = queue[(q+k) % n];
+         const std::lock_guard<std::mutex> lock(d.mutex);
+         if (d.task.size() == 0) continue;
+         if (k == 0)
+            task = d.task.front(), d.task.pop_front();
+         else
+            task = d.task.back (), d.task.pop_back ();
+         return true;
+      }
+      return false;
+   }
+
+public:
+
+   // steal_queue(number of queues)
+   explicit steal_queue(const unsigned n) :
+      queue(op::max(1u,n)), pending(0), pushed(0), idle(0)
+   { }
+
+   // size: number of queues
+   unsigned size() const { return unsigned(queue.size()); }
+
+   // starving: is some thread out of work?
+   bool starving() const { return idle != 0; }
+
+   // push: to the back of queue q
+   void push(const unsigned q, const TASK &task)
+   {
+      deque_t &d = queue[q % size()];
+      {
+         const std::lock_guard<std::mutex> lock(d.mutex);
+         d.task.push_back(task);
+         ++pending;
+      }
+      ++pushed;
+      if (idle != 0) wake();
+   }
+
+   // run: as thread q, do action(task,q) until every task, including any that
+   // are pushed along the way, is finished
+   template<class ACTION>
+   void run(const unsigned q, const ACTION &action)
+   {
+      TASK task;
+      bool waiting = false;
+      unsigned tries = 0;
+
+      while (pending != 0) {
+         const ulong seen = pushed;
+         if (take(q % size(), task)) {
+            if (waiting) --idle, waiting = false;
+            tries = 0;
+            action(task, q % size());
+            if (--pending == 0) wake();
+            continue;
+         }
+
+         if (!waiting) ++idle, waiting = true;
+         if (++tries < spin)
+            std::this_thread::yield();
+         else {
+            std::unique_lock<std::mutex> lock(park);
+            wakeup.wait(lock, [&]() { return pushed != seen || pending == 0; });
+         }
+      }
+
+      if (waiting) --idle;
+   }
+};
+
+} // namespace detail
@@ -20,7 +20,7 @@ kip_process(one)
    // process operands
    vec_t &vec = kip_data.vec();
    kip_data.nop = vec.size();
-   std::vector<minimum_and_ptr<real,shape<real,tag>>> min_and_op(kip_data.nop);
+   scratch<minimum_and_ptr<real,shape<real,tag>>> min_and_op(kip_data.nop);
 
    for (ulong i = 0;  i < kip_data.nop;  ++i) {
       vec[i].op->isoperand = true;
@@ -53,7 +53,7 @@ kip_process(one)
       return rv;
    }
 
-   std::vector<real> minin(nary.total_in);  ulong n = 0;
+   scratch<real> minin(nary.total_in);  ulong n = 0;
    for (ulong i = 0;  i < kip_data.nop;  ++i)
       if (vec[i].in)
          minin[n++] = min_and_op[i].min;
@@ -20,7 +20,7 @@ kip_process(ors)
    // process operands
    vec_t &vec = kip_data.vec();
    kip_data.nop = vec.size();
-   std::vector<minimum_and_ptr<real,shape<real,tag>>> min_and_op(kip_data.nop);
+   scratch<minimum_and_ptr<real,shape<real,tag>>> min_and_op(kip_data.nop);
 
    for (ulong i = 0;  i < kip_data.nop;  ++i) {
       vec[i].op->isoperand = true;
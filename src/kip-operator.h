@@ -84,34 +84,90 @@ public:
 
 
 // grower
+// A stack of T's, for operators' per-call workspace: more(count) gives count
+// contiguous T's, and less(count) gives back those of the latest more() not
+// yet given back. The T's are kept, not destroyed, from one call to the next,
+// so that, once the grower has grown, calls don't allocate. Blocks of T's
+// never move, so an outer call's T's survive an inner call's more().
 template<class T>
 class grower {
-   std::vector<T> vec;
-   ulong position;
+   class block_t {
+   public:
+      std::unique_ptr<T[]> data;
+      ulong size = 0, used = 0;
+   };
+
+   // Blocks before current are in use; blocks after it are not
+   std::vector<block_t> block;
+   ulong current;
 
 public:
    // grower()
-   grower() : position(0) { }
+   grower() : current(0) { }
 
    // more(count)
    T *more(const ulong count)
    {
-      const ulong available = vec.size() - position;
-      if (available < count)
-         vec.insert(vec.end(), count-available, T());
-         /*
-         for (ulong i = 0;  i < count-available;  ++i)
-            vec.push_back(T());
-         */
-
-      T *const operand = &vec[position];
-      position += count;
+      if (count == 0) return nullptr;
+      if (current < block.size() &&
+          block[current].used &&
+          block[current].size - block[current].used < count)
+         ++current;
+      if (current == block.size())
+         block.push_back(block_t());
+
+      block_t &b = block[current];
+      if (b.size < count) {
+         // unused, so replace it
+         const ulong prev = current ? block[current-1].size : 0;
+         b.size = op::max(count, ulong(16), 2*prev);
+         b.data.reset(new T[b.size]);
+      }
+
+      T *const operand = &b.data[b.used];
+      b.used += count;
       return operand;
    }
 
    // less(count)
    void less(const ulong count)
    {
-      position -= count;
+      if (count == 0) return;
+      block[current].used -= count;
+      if (block[current].used == 0 && current > 0)
+         --current;
+   }
+};
+
+
+
+// scratch
+// count T's from the calling thread's grower<T>, for the scratch's lifetime.
+// Per-call workspace for operators, which are called from many threads at
+// once, and recursively, for nested operators.
+template<class T>
+class scratch {
+   grower<T> &work;
+   const ulong count;
+   T *const ptr;
+
+   static grower<T> &pool()
+   {
+      static thread_local grower<T> g;
+      return g;
    }
+
+public:
+   explicit scratch(const ulong _count) :
+      work(pool()), count(_count), ptr(work.more(_count))
+   { }
+
+  ~scratch() { work.less(count); }
+
+   scratch(const scratch &) = delete;
+   scratch &operator=(const scratch &) = delete;
+
+   T *begin() const { return ptr; }
+   T *end  () const { return ptr + count; }
+   T &operator[](const ulong i) const { return ptr[i]; }
 };
@@ -84,6 +84,7 @@ public:
    real q;
    real fac;
    const kip::shape<real,base> *shape;
+   const kip::shape<real,base> *top;  // the model's shape; see get_first()
    const base *color;
    normalized isnormalized;
 
@@ -168,30 +169,93 @@ class afew {
    inq<real,base> buffer[length], *ptr;
    ulong bufsize, num;
 
-public:
+   // stamp: for storage from the thread's afew_arena, the arena's epoch at
+   // the time; else (buffer, or heap) 0
+   ulong stamp;
 
-   // constructor
-   explicit afew() : ptr(buffer), bufsize(length), num(0) { }
+   // grow(n): room for n, keeping what we have
+   void grow(const ulong n)
+   {
+      ulong epoch = 0;
+      inq<real,base> *newptr = (inq<real,base> *)
+         detail::afew_arena::allocate(n*sizeof(inq<real,base>), epoch);
+      if (newptr)
+         for (ulong i = 0;  i < n;  ++i)
+            new (newptr+i) inq<real,base>;
+      else
+         newptr = new inq<real,base>[n];
 
-   // destructor
-   ~afew()
+      for (ulong i = 0;  i < num;  ++i)
+         newptr[i] = ptr[i];
+      release();
+      ptr = newptr;
+      bufsize = n;
+      stamp = epoch;
+   }
+
+   // release: heap storage, if we have it; arena storage is reclaimed by
+   // the arena's reset()
+   void release()
    {
-      if (ptr != buffer)
+      if (ptr != buffer && !stamp)
          delete[] ptr;
    }
 
+   // fresh
+   // If our storage is from the arena, before its last reset, then it's no
+   // longer ours; go back to the buffer. Called by the functions with which
+   // an inall() begins filling us, so that an afew that's kept from pixel to
+   // pixel (as in operators' workspace) doesn't write to reclaimed storage.
+   void fresh()
+   {
+      if (stamp && stamp != detail::afew_arena::epoch()) {
+         ptr = buffer;
+         bufsize = length;
+         stamp = 0;
+         num = 0;
+      }
+   }
+
+   // take: from's contents, for the move functions, when we have only our
+   // buffer
+   void take(afew &from) noexcept
+   {
+      num = from.num;
+      if (from.ptr == from.buffer)
+         for (ulong i = 0;  i < num;  ++i)
+            buffer[i] = from.buffer[i];
+      else {
+         ptr = from.ptr;
+         bufsize = from.bufsize;
+         stamp = from.stamp;
+         from.ptr = from.buffer;
+         from.bufsize = length;
+         from.stamp = 0;
+      }
+      from.num = 0;
+   }
+
+public:
+
+   // constructor
+   explicit afew() : ptr(buffer), bufsize(length), num(0), stamp(0) { }
+
+   // destructor
+  ~afew() { release(); }
+
    // copy constructor
    afew(const afew &from) :
-      num(from.num)
+      ptr(buffer), bufsize(length), num(0), stamp(0)
    {
-      if (from.ptr == from.buffer) {
-         bufsize = length;
-         ptr = buffer;
-      } else
-         ptr = new inq<real,base>[bufsize = from.bufsize];
+      assign(from);
+   }
 
-      for (ulong i = 0;  i < num;  ++i)
-         ptr[i] = from.ptr[i];
+   // move constructor
+   // Takes from's storage, if it isn't from's buffer
+   afew(afew &&from) noexcept :
+      ptr(buffer), bufsize(length), num(0), stamp(0)
+   {
+      take(from);
    }
 
    // copy assignment
@@ -200,31 +264,26 @@ public:
       return assign(from);
    }
 
+   // move assignment
+   afew &operator=(afew &&from) noexcept
+   {
+      if (&from != this) {
+         release();
+         ptr = buffer;
+         bufsize = length;
+         stamp = 0;
+         take(from);
+      }
+      return *this;
+   }
+
    // assign
-   // zzz depending on usage, we might be able to get away with a shallow
-   // copy; for now, do a deep copy
    afew &assign(const afew &from)
    {
-      if (from.ptr == from.buffer) {
-         // "from" uses buffer memory; do the same here
-         if (ptr != buffer)
-            delete[] ptr;
-         bufsize = length;
-         ptr = buffer;
-      } else {
-         // "from" uses allocated memory; do the same here
-         if (ptr == buffer) {
-            bufsize = from.bufsize;
-            ptr = new inq<real,base>[bufsize];
-         } else {
-            if (bufsize == from.bufsize) {
-               // nothing
-            } else {
-               delete[] ptr;
-               bufsize = from.bufsize;
-               ptr = new inq<real,base>[bufsize];
-            }
-         }
+      fresh();
+      if (from.num > bufsize) {
+         num = 0;  // nothing to keep
+         grow(from.num);
       }
 
       num = from.num;
@@ -249,21 +308,15 @@ public:
    inq<real,base> &push(const inq<real,base> &value)
    {
       kip_assert_index(num <= bufsize);
-      if (num == bufsize) {
-         bufsize += bufsize;
-         inq<real,base> *const newptr = new inq<real,base>[bufsize];
-         for (ulong i = 0;  i < num;  ++i)
-            newptr[i] = ptr[i];
-         if (ptr != buffer)
-            delete[] ptr;
-         ptr = newptr;
-      }
+      if (num == bufsize)
+         grow(bufsize + bufsize);
       return ptr[num++] = value;
    }
 
    // one()
    inq<real,base> &one()
    {
+      fresh();
       num = 1;
       return ptr[0];
    }
@@ -271,12 +324,14 @@ public:
    // reset()
    void reset()
    {
+      fresh();
       num = 0;
    }
 
    // convex()
    void convex()
    {
+      fresh();
       num = 0;
    }
 
@@ -302,6 +357,7 @@ public:
    // four()
    void four()
    {
+      fresh();
       num = 0;
    }
 
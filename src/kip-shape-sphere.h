@@ -161,6 +161,7 @@ kip_inall(sphere)
 {
    const real p = dot(f,diff), h = p*p - m;
    if (h < 0) return false;
+   ints.reset();  // for its storage; we set the size below
 
    if (this->interior) {
       ints[0] = p + std::sqrt(h);
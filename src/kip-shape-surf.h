@@ -1,46 +1,53 @@
 
 // -----------------------------------------------------------------------------
-// binner
+// tri_prim
+// tri_hit
 // -----------------------------------------------------------------------------
 
-template<class T>
-class binner {
-   array<1,std::vector<T>> linear;
+namespace detail {
 
+// tri_prim: a tri's bounding box, for building surf's hierarchy
+template<class real>
+class tri_prim {
 public:
+   point<real> min, max;
+   u32 tri;
+};
 
-   // Each surf that's an *operand* contains its own binner. Some bins of some
-   // of these surfs may not be reached during a ray trace. Therefore, although
-   // each global bin is, obviously, reached during any ray trace, we can defer
-   // sorting the corresponding private bins of each surf's binner until+unless
-   // that surf is reached in that bin. This deferral does seem to give a small
-   // but meaningful speed increase. The following vector<bool> tells us, for
-   // each bin of a particular binner, whether or not the bin has been sorted.
-   std::vector<bool> sorted;
-
-   // reset
-   template<class E>
-   void reset(const E &engine)
-   {
-      // clear
-      for (ulong bin = linear.size();  bin--; )  // for each bin
-         linear[bin].clear();
-
-      // resize (not upsize) can necessitate fewer above clear()s in future
-      // calls, and is a no-op except on the first call, or after someone
-      // has changed engine's hzone and/or vzone, which is probably uncommon.
-      // And because resize() is typically a no-op, clear()s were necessary
-      // so that the previous bin contents aren't there.
-      const unsigned num_zone = engine.hzone * engine.vzone;
-      linear.resize(num_zone);
-
-      // sorted
-      sorted.assign(num_zone,false);
-   }
+// tri_hit
+// Does the ray eyeball - t*diff meet triangle (u,v,w) for some t in (0,qmin)?
+// If so, gives t, and the unit normal on the eyeball's side. This is the
+// Moller-Trumbore test; unlike tri::infirst(), it needs no per-view setup.
+template<class real>
+inline bool tri_hit(
+   const point<real> &u, const point<real> &v, const point<real> &w,
+   const eyetardiff<real> &etd, const real qmin,
+   real &t, point<real> &normal
+) {
+   const point<real> e1 = v - u, e2 = w - u;
+   const point<real> dir(-etd.diff.x, -etd.diff.y, -etd.diff.z);
+   const point<real> p = cross(dir,e2);
+   const real det = dot(e1,p);
+   if (det == 0) return false;  // parallel, or degenerate tri
+
+   const real rec = 1/det;
+   const point<real> s = etd.eyeball - u;
+   const real a = dot(s,p)*rec;
+   if (a < 0 || a > 1) return false;
+
+   const point<real> r = cross(s,e1);
+   const real b = dot(dir,r)*rec;
+   if (b < 0 || a+b > 1) return false;
+
+   t = dot(e2,r)*rec;
+   if (!(0 < t && t < qmin)) return false;
+
+   const point<real> c = cross(e1,e2);
+   normal = ((dot(c,etd.diff) < 0 ? -1 : 1)/mod(c))*c;
+   return true;
+}
 
-   // operator[]
-   std::vector<T> &operator[](const ulong i) { return linear(i); }
-};
+} // namespace detail
 
 
 
@@ -58,9 +65,25 @@ class surf : public shape<real,tag> {
    mutable real xmin, ymin, zmin;
    mutable real xmax, ymax, zmax;
 
-   // mint
-   // minimum eyeball-to-tri distances, and (to-be-)depth-sorted tri access
-   mutable binner<minimum_and_ptr<real,kip::tri<real,tag>>> mint;
+   // tree
+   // Bounding volume hierarchy over the tris, for infirst(), inall(), and
+   // dry(). It doesn't depend on the view, so it's built when first needed,
+   // and rebuilt only if node, tri, or revision changes; see current().
+   mutable std::vector<detail::bvh_node<real>> tree;
+   mutable std::vector<u32> order;  // tri indices, in the tree's leaf order
+   mutable std::vector<std::pair<const void *, ulong>> signature;
+   static constexpr unsigned leaf_size = 4;
+
+   bool current() const;
+   void rebuild() const;
+   bool tree_dry(const rotate<3,real,op::part,op::unscaled> &) const;
+
+   // source
+   // If non-null, this surf is a per-view copy that uses source's nodes, tris,
+   // and hierarchy in place of its own; see share()
+   const surf *source = nullptr;
+   void borrow() const;
+
 
 public:
 
@@ -77,6 +100,35 @@ public:
    mutable std::vector<tri_t> tri;
    mutable std::vector<bool> used;
 
+   // revision
+   // The hierarchy over the tris is rebuilt automatically if node or tri is
+   // resized or reallocated. If you modify existing nodes or tris in place,
+   // increment this yourself.
+   ulong revision = 0;
+
+   // share(from)
+   // Makes this surf a copy of from that has its own base shape data, e.g. its
+   // per-view interior flag, but uses from's nodes, tris, and hierarchy rather
+   // than copies of them. from must outlive this surf, and mustn't change while
+   // this surf is in use. Returns *this.
+   surf &share(const surf &from)
+   {
+      this->shape<real,tag>::operator=(from);
+      node.clear();  tri.clear();  used.clear();
+      tree.clear();  order.clear();  signature.clear();
+      revision = from.revision;
+      source = &from.geometry();
+
+      // build the hierarchy now, so that views needn't race to build it
+      if (!source->current())
+         source->rebuild();
+      borrow();
+      return *this;
+   }
+
+   // geometry: the surf whose nodes and tris are in use
+   const surf &geometry() const { return source ? *source : *this; }
+
 
    // ------------------------
    // Push
@@ -136,8 +188,10 @@ public:
 
    // surf(surf)
    surf(const surf &from) :
-      shape<real,tag>(from), node(from.node), tri(from.tri)
+      shape<real,tag>(from), node(from.node), tri(from.tri),
+      revision(from.revision)
    {
+      source = from.source;
    }
 
 
@@ -151,6 +205,9 @@ public:
       this->shape<real,tag>::operator=(from);
       node = from.node;
       tri  = from.tri;
+      revision = from.revision;
+      source = from.source;
+      signature.clear();  // containers may have kept their addresses
       return *this;
    }
 };
@@ -161,58 +218,90 @@ public:
 // Functions
 // -----------------------------------------------------------------------------
 
-// forward: uprepare_tri
-namespace detail {
-   template<class element_t, class real, class base, class BINS>
-   inline real uprepare_tri(
-      const engine<real> &, const vars<real,base> &,
-      BINS &, const surf<real,base> &, const bool
-   );
+// current
+template<class real, class tag>
+inline bool surf<real,tag>::current() const
+{
+   using pair = std::pair<const void *, ulong>;
+   return signature.size() == 3 &&
+      signature[0] == pair(node.data(), ulong(node.size())) &&
+      signature[1] == pair(tri .data(), ulong(tri .size())) &&
+      signature[2] == pair(nullptr, revision);
 }
 
 
 
-// process
-kip_process(surf)
+// rebuild
+template<class real, class tag>
+void surf<real,tag>::rebuild() const
 {
+   using pair = std::pair<const void *, ulong>;
+   signature.clear();
+   signature.push_back(pair(node.data(), ulong(node.size())));
+   signature.push_back(pair(tri .data(), ulong(tri .size())));
+   signature.push_back(pair(nullptr, revision));
+
    // xmin,ymin,zmin, xmax,ymax,zmax, degenerate
    surf<real,tag>::aabb();
 
+   // bounding box of each tri
+   const ulong ntri = tri.size();
+   std::vector<detail::tri_prim<real>> prim(ntri);
+   for (ulong t = 0;  t < ntri;  ++t) {
+      const point<real> &u = node[tri[t].u];
+      const point<real> &v = node[tri[t].v];
+      const point<real> &w = node[tri[t].w];
+
+      prim[t].min(op::min(u.x,v.x,w.x), op::min(u.y,v.y,w.y),
+                  op::min(u.z,v.z,w.z));
+      prim[t].max(op::max(u.x,v.x,w.x), op::max(u.y,v.y,w.y),
+                  op::max(u.z,v.z,w.z));
+      detail::hpad(prim[t].min, prim[t].max);
+      prim[t].tri = u32(t);
+   }
+
+   // hierarchy
+   tree.clear();
+   if (ntri) detail::hbuild(prim, tree, 0, u32(ntri), leaf_size);
+
+   order.resize(ntri);
+   for (ulong t = 0;  t < ntri;  ++t)
+      order[t] = prim[t].tri;
+}
+
+
+
+// borrow
+// For a sharing surf: bounding box and degenerate, from the source
+template<class real, class tag>
+inline void surf<real,tag>::borrow() const
+{
+   xmin = source->xmin;  ymin = source->ymin;  zmin = source->zmin;
+   xmax = source->xmax;  ymax = source->ymax;  zmax = source->zmax;
+   degenerate = source->degenerate;
+}
+
+
+
+// process
+kip_process(surf)
+{
+   // The hierarchy, and with it the bounding box and degenerate
+   if (source)
+      borrow();
+   else if (!current())
+      rebuild();
+
    // interior
    this->interior = surf<real,tag>::inside(eyeball);
 
-   // ----------------
-   // For global surf
-   // ----------------
-
-   // minimum needed iff surf is operand
-   if (!this->isoperand) return 0;
-
-   // ----------------
-   // For operand surf
-   // ----------------
-
-   // process the tris
-   mint.reset(engine);
-   return detail::uprepare_tri<minimum_and_ptr<real,kip::tri<real,tag>>>(
-      engine,
-      vars,
-      mint,
-      *this,
-      false  // "object border", false from here
-   );
-   // zzz
-   // Note, 2013-11-17: I'm confused as to the interaction of this uprepare_tri
-   // call versus the one called from uprepare_surf elsewhere. In principle, it
-   // doesn't seem like this call should be done here. Were we attempting to
-   // reuse code? Is everything done by uprepare_tri really needed here? It's
-   // confusing, in retrospect, how surf/tri was fit into a system that really
-   // wasn't designed to handle one object (surf) made up of another (tri). We
-   // should think about how to clean up this whole system. I like having surfs,
-   // which are regarded as solid (unlike an unrelated set of tri objects), and
-   // which can work naturally with our unary, binary, and nary operators. But,
-   // still, we should figure out precisely what we were doing/thinking.
-
+   // minimum: distance to the bounding box
+   if (degenerate) return 0;
+   return mod(point<real>(
+      op::max(xmin - eyeball.x, real(0), eyeball.x - xmax),
+      op::max(ymin - eyeball.y, real(0), eyeball.y - ymax),
+      op::max(zmin - eyeball.z, real(0), eyeball.z - zmax)
+   ));
 } kip_end
 
 
@@ -220,6 +309,16 @@ kip_process(surf)
 // aabb
 kip_aabb(surf)
 {
+   // sharing surf
+   if (source) {
+      borrow();
+      return degenerate
+         ? bbox<real>(false,1,0,false, false,1,0,false, false,1,0,false)
+         : bbox<real>(true,xmin, xmax,true,
+                      true,ymin, ymax,true,
+                      true,zmin, zmax,true);
+   }
+
    // bookkeeping
    const ulong ntri = tri.size();
    if ((degenerate = ntri == 0))
@@ -301,29 +400,70 @@ kip_dry(surf)
        seg.ge(point<real>(xmax,ymin,zmin)))
       return true;
 
+   // check the tris, by way of the hierarchy if it's current
+   const surf<real,tag> &g = geometry();
+   if (g.current())
+      return g.tree_dry(seg);
+
    // check the points
    // Note: we could also require used[n] in the conditional, but in the normal
    // case of surfs that don't have extraneous nodes, doing so just wastes time.
-   for (ulong n = node.size();  n--; )
-      if (seg.lt(node[n]))
+   for (ulong n = g.node.size();  n--; )
+      if (seg.lt(g.node[n]))
          return false;
    return true;
 } kip_end
 
 
 
+// tree_dry
+// Like dry(), but skips subtrees whose boxes are dry
+template<class real, class tag>
+bool surf<real,tag>::tree_dry(
+   const rotate<3,real,op::part,op::unscaled> &seg
+) const {
+   if (tree.size() == 0) return true;
+
+   // stack; see max_depth
+   u32 stack[detail::bvh_node<real>::max_depth+1];
+   unsigned size = 0;
+   stack[size++] = 0;
+
+   while (size) {
+      const u32 index = stack[--size];
+      const detail::bvh_node<real> &n = tree[index];
+      if (detail::hdry(seg, n.min, n.max)) continue;
+
+      if (n.count) {
+         for (u32 k = n.first;  k < n.first+n.count;  ++k) {
+            const tri_t &t = tri[order[k]];
+            if (seg.lt(node[t.u]) || seg.lt(node[t.v]) || seg.lt(node[t.w]))
+               return false;
+         }
+      } else {
+         stack[size++] = n.first;
+         stack[size++] = index+1;
+      }
+   }
+
+   return true;
+}
+
+
+
 // check
 kip_check(surf)
 {
-   const ulong nnode = node.size();
-   const ulong ntri  = tri .size();
+   const surf<real,tag> &g = geometry();
+   const ulong nnode = g.node.size();
+   const ulong ntri  = g.tri .size();
    diagnostic rv = diagnostic::good;
 
    // Check each tri...
    for (ulong t = 0;  t < ntri;  ++t) {
-      const ulong u = tri[t].u;
-      const ulong v = tri[t].v;
-      const ulong w = tri[t].w;
+      const ulong u = g.tri[t].u;
+      const ulong v = g.tri[t].v;
+      const ulong w = g.tri[t].w;
 
 
       // Require: u < nnode,  v < nnode,  w < nnode
@@ -358,7 +498,7 @@ kip_check(surf)
       // node[v] != node[w]. But don't bother if u == v, u == w,
       // or v == w, respectively, as these were already diagnosed.
       #define kip_surf_check(a,b)\
-         if (a != b && node[a] == node[b]) {\
+         if (a != b && g.node[a] == g.node[b]) {\
             std::ostringstream oss;\
             oss << "Surf's tri has coincident vertices: node[tri[" << t\
                 << "]." #a "()] == node[tri[" << t << "]." #b "()] == " << a;\
@@ -443,37 +583,103 @@ kip_randomize(surf)
 // in*
 // -----------------------------------------------------------------------------
 
-// infirst
-kip_infirst(surf)
-{
-   // bookkeeping
-   std::vector<minimum_and_ptr<real,kip::tri<real,tag>>> &bin =
-      mint[insub.nzone];
-   const ulong ntri = bin.size();  if (ntri == 0) return false;
-
-   // depth-sort bin, if necessary
-   if (!mint.sorted[insub.nzone]) {
-      std::sort(
-         bin.begin(), bin.end(),
-         detail::less<real,kip::tri<real,tag>>()
-      );
-      mint.sorted[insub.nzone] = true;
+// surf_first, surf_all: for hwalk()
+namespace detail {
+
+template<class real, class tag>
+class surf_first {
+   const surf<real,tag> &s, &g;  // shape, geometry
+   const std::vector<u32> &order;
+   const eyetardiff<real> &etd;
+   inq<real,tag> &q;
+
+public:
+   bool found;
+
+   explicit surf_first(
+      const surf<real,tag> &_s, const std::vector<u32> &_order,
+      const eyetardiff<real> &_etd, inq<real,tag> &_q
+   ) :
+      s(_s), g(_s.geometry()), order(_order), etd(_etd), q(_q), found(false)
+   { }
+
+   bool skip(const bvh_node<real> &) const { return false; }
+
+   void operator()(const bvh_node<real> &leaf, real &qmin)
+   {
+      real t;  point<real> normal;
+      for (u32 k = leaf.first;  k < leaf.first+leaf.count;  ++k) {
+         const kip::tri<real,tag> &tri = g.tri[order[k]];
+         if (tri_hit(g.node[tri.u], g.node[tri.v], g.node[tri.w],
+                     etd, qmin, t, normal)) {
+            q = qmin = t;
+            q.inter = etd.eyeball - t*etd.diff;
+            q.set(normal, &tri, normalized::yes).color = &s.base();
+            found = true;
+         }
+      }
    }
+};
 
-   // examine tris
-   q = qmin;  bool found = false;
-   for (unsigned t = 0;  t < ntri && bin[t].min < q;  ++t) {
-      inq<real,tag> qnew;
-      const minend &fine = bin[t].shape->mend;
+template<class real, class tag>
+class surf_all {
+   const surf<real,tag> &s, &g;  // shape, geometry
+   const std::vector<u32> &order;
+   const eyetardiff<real> &etd;
+   afew<real,tag> &ints;
 
-      if (fine.imin <= insub.i && insub.i < fine.iend &&
-          fine.jmin <= insub.j && insub.j < fine.jend &&
-          bin[t].shape->tri_t::infirst(etd, insub, q, qnew))
-         q = qnew, found = true;
+public:
+   bool found;
+
+   explicit surf_all(
+      const surf<real,tag> &_s, const std::vector<u32> &_order,
+      const eyetardiff<real> &_etd, afew<real,tag> &_ints
+   ) :
+      s(_s), g(_s.geometry()), order(_order), etd(_etd), ints(_ints),
+      found(false)
+   { }
+
+   bool skip(const bvh_node<real> &) const { return false; }
+
+   void operator()(const bvh_node<real> &leaf, real &qmin)
+   {
+      real t;  point<real> normal;
+      inq<real,tag> q;
+      for (u32 k = leaf.first;  k < leaf.first+leaf.count;  ++k) {
+         const kip::tri<real,tag> &tri = g.tri[order[k]];
+         if (tri_hit(g.node[tri.u], g.node[tri.v], g.node[tri.w],
+                     etd, qmin, t, normal)) {
+            q = t;
+            q.inter = etd.eyeball - t*etd.diff;
+            q.set(normal, &tri, normalized::yes).color = &s.base();
+            ints.push(q);
+            found = true;
+         }
+      }
    }
+};
+
+} // namespace detail
+
+
+
+// infirst
+kip_infirst(surf)
+{
+   // ray: eyeball + t*dir, where dir = -diff
+   const point<real> inv(
+      detail::hinverse(-diff.x),
+      detail::hinverse(-diff.y),
+      detail::hinverse(-diff.z)
+   );
+
+   real qnear = qmin;
+   const surf<real,tag> &g = geometry();
+   detail::surf_first<real,tag> visit(*this, g.order, etd, q);
+   detail::hwalk(g.tree, eyeball, inv, qnear, visit);
 
    // tri normals compute as "most toward" eyeball; for surf may need reverse...
-   return found ? this->interior ? q.reverse(), true : true : false;
+   return visit.found ? this->interior ? q.reverse(), true : true : false;
 } kip_end
 
 
@@ -481,39 +687,26 @@ kip_infirst(surf)
 // inall
 kip_inall(surf)
 {
-   // bookkeeping
-   std::vector<minimum_and_ptr<real,kip::tri<real,tag>>> &bin =
-      mint[insub.nzone];
-   const ulong ntri = bin.size();  if (ntri == 0) return false;
-
-   // depth-sort bin, if necessary
-   if (!mint.sorted[insub.nzone]) {
-      std::sort(
-         bin.begin(), bin.end(),
-         detail::less<real,kip::tri<real,tag>>()
-      );
-      mint.sorted[insub.nzone] = true;
-   }
-
-   // examine tris
-   bool found = false;
-   for (unsigned t = 0;  t < ntri && bin[t].min < qmin;  ++t) {
-      inq<real,tag> q;
-      const minend &fine = bin[t].shape->mend;
+   // ray: eyeball + t*dir, where dir = -diff
+   const point<real> inv(
+      detail::hinverse(-diff.x),
+      detail::hinverse(-diff.y),
+      detail::hinverse(-diff.z)
+   );
 
-      if (fine.imin <= insub.i && insub.i < fine.iend &&
-          fine.jmin <= insub.j && insub.j < fine.jend &&
-          bin[t].shape->tri_t::infirst(etd, insub, qmin, q))
-         ints.push(q), found = true;
-   }
+   real qfar = qmin;
+   const surf<real,tag> &g = geometry();
+   ints.reset();
+   detail::surf_all<real,tag> visit(*this, g.order, etd, ints);
+   detail::hwalk(g.tree, eyeball, inv, qfar, visit);
 
    // reverse normals, as necessary
-   if (found) {
+   if (visit.found) {
       ints.sort();  const ulong size = ints.size();
       for (ulong i = !this->interior;  i < size;  i += 2)
          ints[i].reverse();
    }
-   return found;
+   return visit.found;
 } kip_end
 
 
@@ -583,8 +776,9 @@ kip_read_value(surf) {
 kip_ostream(surf) {
    bool okay;
 
-   const ulong nnode = obj.node.size();
-   const ulong ntri  = obj.tri .size();
+   const surf<real,tag> &g = obj.geometry();
+   const ulong nnode = g.node.size();
+   const ulong ntri  = g.tri .size();
 
    // stub
    if (format == format_t::format_stub)
@@ -597,12 +791,12 @@ kip_ostream(surf) {
       // nodes
       okay = k << "surf(" << nnode;
       for (ulong n = 0;  n < nnode && okay;  ++n)
-         okay = k << ", " << obj.node[n];
+         okay = k << ", " << g.node[n];
 
       // tris
       okay = okay && k << ", " << ntri;
       for (ulong t = 0;  t < ntri  && okay;  ++t)
-         okay = k << ", " << obj.tri [t];
+         okay = k << ", " << g.tri [t];
 
       // finish
       okay = okay && write_finish(k, obj, true);
@@ -613,12 +807,12 @@ kip_ostream(surf) {
       // nodes
       okay = k << "surf(\n   " && k.indent() << nnode;
       for (ulong n = 0;  n < nnode && okay;  ++n)
-         okay = k << ",\n   " && k.indent() << obj.node[n];
+         okay = k << ",\n   " && k.indent() << g.node[n];
 
       // tris
       okay = okay && k << ",\n   " && k.indent() << ntri;
       for (ulong t = 0;  t < ntri  && okay;  ++t)
-         okay = k << ",\n   " && k.indent() << obj.tri [t];
+         okay = k << ",\n   " && k.indent() << g.tri [t];
 
       // finish
       okay = okay && write_finish(k, obj, false);
@@ -141,16 +141,6 @@ public:
    tag &base() { return thebase; }
 
 
-   // --------------------------------
-   // Block data, if necessary
-   // --------------------------------
-
-   #ifdef KIP_BLOCK
-      mutable real minimum;
-      mutable int  lastpix;
-   #endif
-
-
    // --------------------------------
    // Primary data
    // --------------------------------
@@ -312,6 +302,35 @@ public:
    virtual ~shape() { }
 
 
+   // --------------------------------
+   // new, delete
+   // --------------------------------
+
+#ifndef kip_no_shape_pool
+   // Shapes made with new come from detail::shape_pool. Deleting through a
+   // shape * gives the derived shape's size, as the virtual destructor makes
+   // delete use the derived shape's operator delete.
+   static void *operator new(const std::size_t size)
+      { return detail::shape_pool::allocate(size); }
+   static void operator delete(void *const ptr, const std::size_t size)
+      { detail::shape_pool::deallocate(ptr, size); }
+
+   // The above hide the global forms, so we provide placement and nothrow
+   // new as well. A nothrow shape is still deleted as above; the matching
+   // deletes here are only for a constructor that throws.
+   static void *operator new(const std::size_t, void *const ptr) noexcept
+      { return ptr; }
+   static void operator delete(void *, void *) noexcept
+      { }
+   static void *operator new(
+      const std::size_t size, const std::nothrow_t &nothrow
+   ) noexcept
+      { return detail::shape_pool::allocate(size, nothrow); }
+   static void operator delete(void *const ptr, const std::nothrow_t &) noexcept
+      { ::operator delete(ptr); }
+#endif
+
+
    // --------------------------------
    // Virtuals (except id())
    // --------------------------------
@@ -771,7 +790,6 @@ inline bool op_all(
 
 // -----------------------------------------------------------------------------
 // minimum_and_ptr
-// vec_reset
 // -----------------------------------------------------------------------------
 
 // minimum_and_ptr
@@ -789,14 +807,6 @@ public:
    { }
 };
 
-// vec_reset
-template<class real, class base>
-class vec_reset {
-public:
-   std::vector<minimum_and_ptr<real,shape<real,base>>> vec;
-   bool reset;
-};
-
 
 
 // -----------------------------------------------------------------------------
@@ -1,348 +1,250 @@
 
-// zzz Need to consider shape.on in this algorithm.
+// For block:
+//    A uniform grid of xzone*yzone*zzone cells is laid over the world-space
+//    bounding boxes of the model's top-level shapes, and each shape is placed
+//    into the cells that its box overlaps. As with bvh, the grid depends only
+//    on the model, so it's kept in vars, and rebuilt only if the model
+//    changes. Per frame, we process() only the shapes whose boxes aren't
+//    outside the view. Per ray, a 3D-DDA walk visits the cells front to back,
+//    stopping at the first cell that ends beyond the nearest intersection
+//    found so far. Unlike the uniform method's screen-space bins, this works
+//    well when the eyeball is inside a dense model.
 
 namespace detail {
 
 // -----------------------------------------------------------------------------
-// block_setup_shape
+// bcell
+// Which cell, along one axis, contains coordinate c?
 // -----------------------------------------------------------------------------
 
-template<class real, class base, class CONTAINER>
-void block_setup_shape(
-   const model<real,base> &model,
-   const engine<real> &engine,
-   vars<real,base> &vars,
-   const real xfac, const real yfac, const real zfac,
-   const CONTAINER &objects
+template<class real>
+inline unsigned bcell(
+   const real c, const real min, const real delta, const unsigned n
 ) {
-   // To silence compiler warnings if KIP_BLOCK is not #defined
-   (void)model;
-   (void)engine;
-   (void)vars;
-   (void)xfac;
-   (void)yfac;
-   (void)zfac;
-   (void)objects;
-
-#ifdef KIP_BLOCK
-   // model.aabb was computed earlier, as the objects were entered
-   const bbox<real> &aabb = model.aabb;
-
-   // for each object of this shape
-   using iter_t = typename CONTAINER::const_iterator;
-   const iter_t end = objects.end();
-   for (iter_t i = objects.begin();  i != end;  ++i) {
-
-      const bbox<real> b = i->aabb();
-      const int  // signed
-         xa = op::max(0, int(xfac*(b.xmin - aabb.xmin))),
-         ya = op::max(0, int(yfac*(b.ymin - aabb.ymin))),
-         za = op::max(0, int(zfac*(b.zmin - aabb.zmin))),
-         xb = op::min(int(engine.xzone)-1, int(xfac*(b.xmax - aabb.xmin))),
-         yb = op::min(int(engine.yzone)-1, int(yfac*(b.ymax - aabb.ymin))),
-         zb = op::min(int(engine.zzone)-1, int(zfac*(b.zmax - aabb.zmin)));
-
-      // drop the current object into the appropriate blocks
-      for (int x = xa;  x <= xb;  ++x)
-      for (int y = ya;  y <= yb;  ++y)
-      for (int z = za;  z <= zb;  ++z)
-         vars.block(x,y,z).vec.
-            push_back(minimum_and_ptr<real,shape<real,base>>(0,*i));
-   }
-
-   // Note: neither "reset" for each block(x,y,z), nor "minimum" for each
-   // block(x,y,z).vec[*], is initialized here. Those get done when we ray
-   // trace --- not during this setup, which just places objects into blocks.
-#endif
+   return op::min(n-1, unsigned(op::max(real(0), (c-min)/delta)));
 }
 
 
 
 // -----------------------------------------------------------------------------
-// bsetup
+// bbuild
+// Place the prims into cells
 // -----------------------------------------------------------------------------
 
-template<class real, class base>
-inline void bsetup(
-   const model<real,base> &model,
-   const engine<real> &engine,
-   vars<real,base> &vars
+template<class real, class base, class MODEL>
+void bbuild(
+   block_t<real,base> &block, MODEL &model, const engine<real> &engine
 ) {
-   // zzz Could do diag,quad,3060,1575 segmenting of some kind here.
-
-   const real xfac = engine.xzone/(model.aabb.xmax - model.aabb.xmin);
-   const real yfac = engine.yzone/(model.aabb.ymax - model.aabb.ymin);
-   const real zfac = engine.zzone/(model.aabb.zmax - model.aabb.zmin);
+   block.prim.clear();
+   block.unbounded.clear();
+   block.first.clear();
+   block.index.clear();
+   block.nx = block.ny = block.nz = 0;
+
+   const functor_collect<real,base> f(block.prim, block.unbounded);
+   allshape(model, f);
+   if (block.prim.size() == 0) return;
+
+   // grid bounds, and cell size
+   hbox<real> box;
+   for (ulong n = 0;  n < block.prim.size();  ++n)
+      box.grow(block.prim[n].min, block.prim[n].max);
+   block.min = box.min;
+   block.max = box.max;
+
+   block.nx = engine.xzone;
+   block.ny = engine.yzone;
+   block.nz = engine.zzone;
+   const point<real> extent = block.max - block.min;
+   block.delta(
+      (extent.x > 0 ? extent.x : real(1))/real(block.nx),
+      (extent.y > 0 ? extent.y : real(1))/real(block.ny),
+      (extent.z > 0 ? extent.z : real(1))/real(block.nz)
+   );
+
+   // Two passes: count the prims in each cell, then place them. In between,
+   // first[c+1] is the count for cell c, and becomes an offset.
+   const ulong ncell = ulong(block.nx)*block.ny*block.nz;
+   block.first.assign(ncell+1, 0);
+
+   for (unsigned pass = 0;  pass < 2;  ++pass) {
+      std::vector<u32> next;
+      if (pass == 1) {
+         for (ulong c = 0;  c < ncell;  ++c)
+            block.first[c+1] += block.first[c];
+         block.index.resize(block.first[ncell]);
+         next.assign(block.first.begin(), block.first.end()-1);
+      }
 
-#define kip_make_setup(type)\
-   block_setup_shape(model,engine,vars, xfac,yfac,zfac, model.type)
-   kip_expand(kip_make_setup,;)
-#undef  kip_make_setup
+      for (u32 n = 0;  n < u32(block.prim.size());  ++n) {
+         const bvh_prim<real,base> &p = block.prim[n];
+         const unsigned
+            xa = bcell(p.min.x, block.min.x, block.delta.x, block.nx),
+            ya = bcell(p.min.y, block.min.y, block.delta.y, block.ny),
+            za = bcell(p.min.z, block.min.z, block.delta.z, block.nz),
+            xb = bcell(p.max.x, block.min.x, block.delta.x, block.nx),
+            yb = bcell(p.max.y, block.min.y, block.delta.y, block.ny),
+            zb = bcell(p.max.z, block.min.z, block.delta.z, block.nz);
+
+         for (unsigned z = za;  z <= zb;  ++z)
+         for (unsigned y = ya;  y <= yb;  ++y)
+         for (unsigned x = xa;  x <= xb;  ++x) {
+            const ulong c = x + block.nx*(y + ulong(block.ny)*z);
+            if (pass == 0)
+               block.first[c+1]++;
+            else
+               block.index[next[c]++] = n;
+         }
+      }
+   }
 }
 
 
 
 // -----------------------------------------------------------------------------
-// next
+// bsetup
 // -----------------------------------------------------------------------------
 
-/*
-2019 jul 15
-Was there a reason I had these, instead of using
-our op::min and op::max functions?
-
-// minref
-template<class T>
-inline const T &minref(const T &a, const T &b)
-   { return a < b ? a : b; }
-
-template<class T>
-inline const T &minref(const T &a, const T &b, const T &c)
-   { return minref(a,minref(b,c)); }
-
-// maxref
-template<class T>
-inline const T &maxref(const T &a, const T &b)
-   { return a < b ? b : a; }
-
-template<class T>
-inline const T &maxref(const T &a, const T &b, const T &c)
-   { return maxref(a,maxref(b,c)); }
-*/
-
-
-
-// next
-template<class T>
-bool next(
-   const T &xmin, const T &xmax, const unsigned xzone, const T &delx,
-   const T &ymin, const T &ymax, const unsigned yzone, const T &dely,
-   const T &zmin, const T &zmax, const unsigned zzone, const T &delz,
-   const T &ax, const T &ay, const T &az,
-   const T &bx, const T &by, const T &bz,
-   T &qseg, unsigned &i, unsigned &j, unsigned &k, unsigned &status
+template<class real, class base, class color>
+void bsetup(
+         model <real,base > &model,
+   const light <real      > &light,
+   const engine<real      > &engine,
+         vars  <real,base > &vars,
+   const image <real,color> &image
 ) {
-   static T dx, xbeg, xfac;
-   static T dy, ybeg, yfac;
-   static T dz, zbeg, zfac;
-
-   if (status == 0) {
-      dx = bx - ax;  T qxmin = (xmin - ax)/dx, qxmax = (xmax - ax)/dx;
-      dy = by - ay;  T qymin = (ymin - ay)/dy, qymax = (ymax - ay)/dy;
-      dz = bz - az;  T qzmin = (zmin - az)/dz, qzmax = (zmax - az)/dz;
-
-      if (qxmax < qxmin) std::swap(qxmin,qxmax);
-      if (qymax < qymin) std::swap(qymin,qymax);
-      if (qzmax < qzmin) std::swap(qzmin,qzmax);
-
-      // qmin, qmax
-      const T qmin = op::max(T(0), maxref(qxmin,qymin,qzmin));
-      const T qmax = minref(qxmax,qymax,qzmax);
-      if (qmax == T(0) || qmax < qmin) return false;
-
-      // indices of entry point
-      i = op::max(0, op::min(int(xzone)-1, int((ax+qmin*dx - xmin)/delx)));
-      j = op::max(0, op::min(int(yzone)-1, int((ay+qmin*dy - ymin)/dely)));
-      k = op::max(0, op::min(int(zzone)-1, int((az+qmin*dz - zmin)/delz)));
-
-      status = 1;
-      return true;
+   block_t<real,base> &block = vars.block;
+   hsegment(engine,vars);
+
+   // (Re)build the grid, if the model or the grid size has changed
+   std::vector<std::pair<const void *, ulong>> sig;
+   hsignature(model, sig);
+   sig.push_back(std::make_pair(nullptr, ulong(engine.xzone)));
+   sig.push_back(std::make_pair(nullptr, ulong(engine.yzone)));
+   sig.push_back(std::make_pair(nullptr, ulong(engine.zzone)));
+   if (sig != block.signature) {
+      block.signature.swap(sig);
+      bbuild(block, model, engine);
    }
 
-   if (status == 1) {
-      // compute xbeg,ybeg,zbeg, xfac,yfac,zfac
-      xbeg = (xmin + (dx > T(0))*delx - ax)/dx;  xfac = delx/dx;
-      ybeg = (ymin + (dy > T(0))*dely - ay)/dy;  yfac = dely/dy;
-      zbeg = (zmin + (dz > T(0))*delz - az)/dz;  zfac = delz/dz;
-      status = 2;
+   // Process prims that aren't outside the view, and unbounded ones
+   const bool object_border = image.border.object;
+   minend screen;
+   screen.imin = 0;  screen.iend = u32(image.hpixel);
+   screen.jmin = 0;  screen.jend = u32(image.vpixel);
+
+   const int nprim = int(block.prim.size());  // int, for OpenMP
+   #ifdef _OPENMP
+      #pragma omp parallel for
+   #endif
+   for (int n = 0;  n < nprim;  ++n) {
+      bvh_prim<real,base> &p = block.prim[ulong(n)];
+      if (hdry(vars.behind, p.min, p.max) ||
+          hdry(vars.left,   p.min, p.max) ||
+          hdry(vars.right,  p.min, p.max) ||
+          hdry(vars.bottom, p.min, p.max) ||
+          hdry(vars.top,    p.min, p.max))
+         p.active = false;
+      else
+         hprocess(light, engine, vars, p, screen, object_border);
    }
 
-   const T x = dx ? xbeg + i*xfac : std::numeric_limits<T>::max();
-   const T y = dy ? ybeg + j*yfac : std::numeric_limits<T>::max();
-   const T z = dz ? zbeg + k*zfac : std::numeric_limits<T>::max();
-
-   const T *const mm = &minref(x,y,z);
-   qseg = *mm;
-   return
-      (&x != mm || ((dx < T(0) && i--) || (T(0) < dx && ++i < xzone))) &&
-      (&y != mm || ((dy < T(0) && j--) || (T(0) < dy && ++j < yzone))) &&
-      (&z != mm || ((dz < T(0) && k--) || (T(0) < dz && ++k < zzone)));
+   for (ulong n = 0;  n < block.unbounded.size();  ++n)
+      hprocess(light, engine, vars,
+               block.unbounded[n], screen, object_border);
 }
 
 
 
 // -----------------------------------------------------------------------------
-// btrace
-// Ray trace, using block method.
+// hfirst
+// Nearest intersection along a ray, for the block method; see htrace_zone()
 // -----------------------------------------------------------------------------
 
-// btrace_shape
-template<class CONTAINER>
-inline void btrace_shape(
-   const CONTAINER &objects
+template<class real, class base>
+const inq<real,base> *hfirst(
+   const block_t<real,base> &block, const eyetardiff<real> &etd,
+   const u32 i, const u32 j, const ulong zone,
+   inq<real,base> &qa, inq<real,base> &qb
 ) {
-   // To silence compiler warnings if KIP_BLOCK is not #defined
-   (void)objects;
-
-#ifdef KIP_BLOCK
-   using iter_t = typename CONTAINER::const_iterator;
-   const iter_t end = objects.end();
-   for (iter_t i = objects.begin();  i != end;  ++i)
-      i->lastpix = -2;
-#endif
-}
-
+   inq<real,base> *qa_ptr = &qa, *qb_ptr = &qb;  // qa_ptr: nearest so far
+   real qmin = std::numeric_limits<real>::max();
+   bool found = false;
+
+   // unbounded shapes
+   for (ulong n = 0;  n < block.unbounded.size();  ++n)
+      if (hfirst_prim(block.unbounded[n], etd, i,j,zone, qmin, *qb_ptr)) {
+         std::swap(qa_ptr,qb_ptr);
+         qmin = real(*qa_ptr);
+         found = true;
+      }
 
+   // ray: eyeball + t*dir, where dir = -diff
+   const point<real> &eyeball = etd.eyeball, inv(
+      hinverse(-etd.diff.x), hinverse(-etd.diff.y), hinverse(-etd.diff.z));
+   real tnear;
+
+   if (block.nx == 0 ||
+      !hslab(block.min, block.max, eyeball, inv, qmin, tnear))
+      return found ? qa_ptr : nullptr;
+
+   // Per axis: current cell, direction of travel, the t at which the ray
+   // leaves the current cell, and the t it takes to cross a cell
+   const unsigned n[3] = { block.nx, block.ny, block.nz };
+   const real
+      e[3] = { eyeball.x, eyeball.y, eyeball.z },
+      f[3] = { etd.diff.x, etd.diff.y, etd.diff.z },
+      r[3] = { inv.x, inv.y, inv.z },
+      m[3] = { block.min.x, block.min.y, block.min.z },
+      d[3] = { block.delta.x, block.delta.y, block.delta.z },
+      tenter = op::max(real(0), tnear);
+
+   int cell[3], step[3];
+   real tmax[3], tdelta[3];
+   for (unsigned a = 0;  a < 3;  ++a) {
+      cell[a] = int(bcell(e[a] - tenter*f[a], m[a], d[a], n[a]));
+      step[a] = r[a] < 0 ? -1 : 1;
+      tmax[a] = (m[a] + real(cell[a] + (step[a] > 0))*d[a] - e[a])*r[a];
+      tdelta[a] = d[a]*std::abs(r[a]);
+   }
 
-// btrace
-template<class real, class base, class color>
-void btrace(
-   const model <real,base > &model,
-   const view  <real      > &view,
-   const light <real      > &light,
-   const engine<real      > &engine,
-         image <real,color> &image,
-         vars  <real,base > &vars
-) {
-   // To silence compiler warnings if KIP_BLOCK is not #defined
-   (void)model;  (void)view;
-   (void)light;  (void)engine;
-   (void)image;  (void)vars;
-
-#ifdef KIP_BLOCK
-   // --------------------------------
-   // setup
-   // --------------------------------
-
-   // for each block: haven't grabbed object minima, or depth-sorted
-   for (unsigned b = 0;  b < engine.xzone*engine.yzone*engine.zzone;  ++b)
-      vars.block[b].reset = true;
-
-   // for each object: set lastpix = -2
-#define kip_make_trace(type) btrace_shape(model.type)
-   kip_expand(kip_make_trace,;)
-#undef  kip_make_trace
-
-
-   // --------------------------------
-   // do it   <-- zzz come up with a better comment than this
-   // --------------------------------
-
-   const bbox<real> &aabb = model.aabb;
-   const real delx = (aabb.xmax - aabb.xmin)/engine.xzone;
-   const real dely = (aabb.ymax - aabb.ymin)/engine.yzone;
-   const real delz = (aabb.zmax - aabb.zmin)/engine.zzone;
-
-   // because image.hpixel/vpixel are references; compiler might think volatile
-   const unsigned hpixel = image.hpixel;
-   const unsigned vpixel = image.vpixel;
-
-   // vertical pixels
-   real z = -vars.vmax + vars.vhalf;
-   for (unsigned v = 0;  v < vpixel;  ++v, z += vars.vfull) {
-
-   // horizontal pixels
-   real y = -vars.hmax + vars.hhalf;
-   for (unsigned h = 0;  h < hpixel;  ++h, y += vars.hfull) {
-
-      // IN THIS BLOCK FOR EACH INDIVIDUAL PIXEL (h,v)
-
-      // initialization: target, diff
-      const point<real> target = vars.eyeball
-         + normalize(vars.t2e.back_0nn(y,z) - vars.eyeball);
-      const point<real> diff = vars.eyeball - view.target;
-
-      // initialization: q, qmin, ptr
-      inq<real,base> q1, *qused = &q1;
-      inq<real,base> q2, *qnext = &q2;
-
-      real qmin = std::numeric_limits<real>::max(), qseg = 0;
-      const shape<real,base> *ptr = nullptr;
-
-      unsigned i, j, k, status = 0;  const int npix = h + hpixel*v;
-      while (
-         next(
-            aabb.xmin, aabb.xmax, engine.xzone, delx,
-            aabb.ymin, aabb.ymax, engine.yzone, dely,
-            aabb.zmin, aabb.zmax, engine.zzone, delz,
-            vars.eyeball.x, vars.eyeball.y, vars.eyeball.z,
-            view.target.x, view.target.y, view.target.z,
-            qseg, i, j, k, status
-         ) &&
-         qmin > qseg
-      ) {
-
-         const unsigned seg = i + engine.xzone*(j + engine.yzone*k);
-
-         // bin: the present segment
-         using vector_t = std::vector<minimum_and_ptr<real,shape<real,base>>>;
-
-         vector_t &bin = vars.block[seg].vec;
-         const ulong size = bin.size();
-         if (size == 0) continue;
-
-         // sort, if we didn't see this bin with any previous pixels
-         if (vars.block[seg].reset) {
-            for (ulong obj = 0;  obj < size;  ++obj)
-               if (bin[obj].shape->lastpix == -2) {  // was reset only
-                  bin[obj].shape->isoperand = false;
-                  bin[obj].minimum = bin[obj].shape->minimum =
-                     bin[obj].shape->process(vars.eyeball, light[0]);
-                  kip_assert(bin[obj].minimum >= 0);
-
-                  bin[obj].shape->lastpix =
-                     // Is interior && solid (not just interior) the correct
-                     // test here? Lately, I haven't had the block algorithm
-                     // working anyway
-                        bin[obj].shape->interior && bin[obj].shape->solid
-                     ?  std::numeric_limits<int>::max()
-                     : -1;
-               } else
-                  bin[obj].minimum = bin[obj].shape->minimum;
-
-            std::sort(bin.begin(), bin.end(), detail::less<real,base>());
-            vars.block[seg].reset = false;
+   // A prim may overlap several cells; remember the last few we tested
+   static constexpr unsigned nmail = 8;
+   u32 mail[nmail] = { u32(-1), u32(-1), u32(-1), u32(-1),
+                       u32(-1), u32(-1), u32(-1), u32(-1) };
+   unsigned nextmail = 0;
+
+   for (;;) {
+      const ulong c = ulong(cell[0]) + n[0]*(
+         ulong(cell[1]) + ulong(n[1])*ulong(cell[2]));
+
+      for (u32 k = block.first[c];  k < block.first[c+1];  ++k) {
+         const u32 index = block.index[k];
+         if (std::find(mail, mail+nmail, index) != mail+nmail) continue;
+         mail[nextmail] = index;
+         nextmail = (nextmail+1) % nmail;
+
+         const bvh_prim<real,base> &p = block.prim[index];
+         if (hslab(p.min, p.max, eyeball, inv, qmin, tnear) &&
+             hfirst_prim(p, etd, i,j,zone, qmin, *qb_ptr)) {
+            std::swap(qa_ptr,qb_ptr);
+            qmin = real(*qa_ptr);
+            found = true;
          }
-
-         // zzz 2013-11-12: really call op_first below???
-         // loop over objects in this bin
-         ulong s = 0;
-         for ( ;  s < size;  ++s)
-            if (bin[s].shape->lastpix < npix) {
-               bin[s].shape->lastpix = npix;
-               if (detail::op_first(
-                  bin[s].shape, view.eyeball, view.target, diff,
-                  insub, qmin, *qused
-               )) {
-                  const real q = qused->q;
-                  kip_assert(0 < q && q < qmin);
-                  ptr = bin[s].shape;  qmin = q;  s++;
-                  break;
-               }
-            }
-
-         for ( ;  s < size && bin[s].minimum < qmin;  ++s)
-            if (bin[s].shape->lastpix < npix) {
-               bin[s].shape->lastpix = npix;
-               if (detail::op_first(
-                  bin[s].shape, eyeball, target, diff,
-                  insub, qmin, *qnext
-               )) {
-                  const real q = qnext->q;
-                  kip_assert(0 < q && q < qmin);
-                  ptr = bin[s].shape;  qmin = q;
-                  std::swap(qused,qnext);
-               }
-            }
-
       }
 
-      // color
-      if (ptr)
-         image(h,v) = detail::pixel_color<color>(*qused);
-   }
+      // next cell, unless the nearest intersection precedes it
+      const unsigned a =
+         tmax[0] <= tmax[1] && tmax[0] <= tmax[2] ? 0
+       : tmax[1] <= tmax[2] ? 1 : 2;
+      if (qmin <= tmax[a]) break;
+
+      cell[a] += step[a];
+      if (cell[a] < 0 || cell[a] >= int(n[a])) break;
+      tmax[a] += tdelta[a];
    }
-#endif
+
+   return found ? qa_ptr : nullptr;
 }
 
 } // namespace detail
@@ -0,0 +1,492 @@
+// For bvh:
+//    A bounding volume hierarchy is built over the world-space bounding boxes,
+//    from aabb(), of the model's top-level shapes. (A surf has a hierarchy of
+//    its own, over its tris; see kip-shape-surf.h.) The hierarchy depends
+//    only on the model, so it's kept in vars, and rebuilt only if the
+//    model changes (see model::revision). Per frame, we cull nodes that lie
+//    outside the view, and process() only the shapes in the surviving leaves.
+//    Per ray, we walk the hierarchy, nearer child first, skipping boxes that
+//    the ray misses, or meets only beyond the nearest intersection so far.
+
+namespace detail {
+
+// -----------------------------------------------------------------------------
+// Helpers
+// -----------------------------------------------------------------------------
+
+// hdry_shape
+// Gives seg_minmax() a shape whose dry() goes through the virtual function,
+// for computing object borders
+template<class real, class base>
+class hdry_shape {
+   const shape<real,base> &s;
+public:
+   explicit hdry_shape(const shape<real,base> &_s) : s(_s) { }
+   bool dry(const rotate<3,real,op::part,op::unscaled> &seg) const
+      { return s.dry(seg); }
+};
+
+
+
+// -----------------------------------------------------------------------------
+// hsignature
+// Identifies the model's shape containers; see model::revision
+// -----------------------------------------------------------------------------
+
+template<class real, class base>
+class functor_signature {
+   using sig_t = std::vector<std::pair<const void *, ulong>>;
+   sig_t &sig;
+
+public:
+   explicit functor_signature(sig_t &_sig) : sig(_sig) { }
+
+   // general
+   template<class CONTAINER>
+   void operator()(const CONTAINER &c) const
+   {
+      sig.push_back(std::make_pair((const void *)c.data(), ulong(c.size())));
+   }
+
+   // surf: nodes and tris, too, as its bounding box depends on them
+   void operator()(const std::vector<surf<real,base>> &c) const
+   {
+      sig.push_back(std::make_pair((const void *)c.data(), ulong(c.size())));
+      for (ulong n = 0;  n < c.size();  ++n) {
+         const surf<real,base> &s = c[n];
+         sig.push_back(std::make_pair(
+            (const void *)s.node.data(), ulong(s.node.size())));
+         sig.push_back(std::make_pair(
+            (const void *)s.tri .data(), ulong(s.tri .size())));
+      }
+   }
+};
+
+template<class real, class base>
+inline void hsignature(
+   model<real,base> &model,
+   std::vector<std::pair<const void *, ulong>> &sig
+) {
+   sig.clear();
+   sig.push_back(std::make_pair(nullptr, model.revision));
+   const functor_signature<real,base> f(sig);
+   allshape(model, f);
+}
+
+
+
+// -----------------------------------------------------------------------------
+// hcollect
+// -----------------------------------------------------------------------------
+
+// Gathers the model's shapes into bounded and unbounded prims. The block
+// method uses this, too.
+template<class real, class base>
+class functor_collect {
+   std::vector<bvh_prim<real,base>> &prim, &unbounded;
+
+public:
+   explicit functor_collect(
+      std::vector<bvh_prim<real,base>> &_prim,
+      std::vector<bvh_prim<real,base>> &_unbounded
+   ) :
+      prim(_prim), unbounded(_unbounded)
+   { }
+
+   // general
+   template<class CONTAINER>
+   void operator()(CONTAINER &c) const
+   {
+      bvh_prim<real,base> p;
+      p.active = false;
+
+      for (ulong n = 0;  n < c.size();  ++n) {
+         const bbox<real> b = c[n].aabb();
+         if (!b.valid()) continue;  // nothing there
+
+         p.shape = &c[n];
+         if (b.finite()) {
+            p.min = b.min();
+            p.max = b.max();
+            hpad(p.min, p.max);
+            prim.push_back(p);
+         } else
+            unbounded.push_back(p);
+      }
+   }
+};
+
+
+// -----------------------------------------------------------------------------
+// hprocess
+// Per-frame preparation of a visible prim
+// -----------------------------------------------------------------------------
+
+template<class real, class base>
+inline void hprocess(
+   const light<real> &light, const engine<real> &engine,
+   const vars<real,base> &vars,
+   bvh_prim<real,base> &p, const minend &screen, const bool object_border
+) {
+   p.active = false;
+   const shape<real,base> &s = *p.shape;
+   if (!s.on) return;
+
+   s.isoperand = false;  // top-level shape
+   const real pmin = s.process(vars.eyeball, light[0], engine, vars);
+   kip_assert(pmin >= 0);  (void)pmin;
+   if (s.dry(vars.behind) || (s.interior && s.solid))
+      return;
+
+   // Bounds on the screen are needed only if we're to draw them; the
+   // hierarchy takes the place of bounds otherwise
+   if (object_border) {
+      minend sub;
+      if (!seg_minmax(
+            engine, vars, hdry_shape<real,base>(s),
+            sub.imin, sub.iend, sub.jmin, sub.jend))
+         return;
+      s.mend.imin = op::round<u32>(vars.hratsub * real(sub.imin));
+      s.mend.iend = op::round<u32>(vars.hratsub * real(sub.iend));
+      s.mend.jmin = op::round<u32>(vars.vratsub * real(sub.jmin));
+      s.mend.jend = op::round<u32>(vars.vratsub * real(sub.jend));
+   } else
+      s.mend = screen;
+
+   p.active = true;
+}
+
+
+
+// -----------------------------------------------------------------------------
+// hsegment
+// Build segmenters, for culling and seg_minmax(); the block method uses this,
+// too. Shapes no longer bin by zone (a surf traces its tris through its own
+// persistent hierarchy), so the segmenters serve only to bound shapes in the
+// image, not to place anything in our tiles.
+// -----------------------------------------------------------------------------
+
+template<class real, class base>
+inline void hsegment(const engine<real> &engine, vars<real,base> &vars)
+{
+   segment_h(engine,vars);
+   segment_v(engine,vars);
+   vars.left   = dry_w(vars, -vars.hmax);
+   vars.right  = dry_e(vars,  vars.hend);
+   vars.bottom = dry_s(vars, -vars.vmax);
+   vars.top    = dry_n(vars,  vars.vend);
+}
+
+
+
+// -----------------------------------------------------------------------------
+// hsetup
+// -----------------------------------------------------------------------------
+
+template<class real, class base, class color>
+void hsetup(
+         model <real,base > &model,
+   const light <real      > &light,
+   const engine<real      > &engine,
+         vars  <real,base > &vars,
+   const image <real,color> &image
+) {
+   bvh_t<real,base> &bvh = vars.bvh;
+
+   hsegment(engine,vars);
+
+   // (Re)build the hierarchy, if the model has changed
+   std::vector<std::pair<const void *, ulong>> sig;
+   hsignature(model, sig);
+   if (sig != bvh.signature) {
+      bvh.signature.swap(sig);
+      bvh.prim.clear();
+      bvh.unbounded.clear();
+      bvh.node.clear();
+      bvh.frame = 0;
+
+      const functor_collect<real,base> f(bvh.prim, bvh.unbounded);
+      allshape(model, f);
+      if (bvh.prim.size())
+         hbuild(bvh.prim, bvh.node, 0, u32(bvh.prim.size()), engine.leaf_size);
+   }
+
+   // Cull nodes outside the view; collect prims in surviving leaves
+   ++bvh.frame;
+   bvh.visible.clear();
+
+   if (bvh.node.size()) {
+      std::vector<u32> stack(1,0);
+      while (stack.size()) {
+         const u32 index = stack.back();  stack.pop_back();
+         const bvh_node<real> &node = bvh.node[index];
+
+         if (hdry(vars.behind, node.min, node.max) ||
+             hdry(vars.left,   node.min, node.max) ||
+             hdry(vars.right,  node.min, node.max) ||
+             hdry(vars.bottom, node.min, node.max) ||
+             hdry(vars.top,    node.min, node.max))
+            continue;
+         node.frame = bvh.frame;
+
+         if (node.count) {
+            for (u32 n = node.first;  n < node.first+node.count;  ++n)
+               bvh.visible.push_back(&bvh.prim[n]);
+         } else {
+            stack.push_back(node.first);
+            stack.push_back(index+1);
+         }
+      }
+   }
+
+   // Process visible prims, and unbounded ones
+   const bool object_border = image.border.object;
+   minend screen;
+   screen.imin = 0;  screen.iend = u32(image.hpixel);
+   screen.jmin = 0;  screen.jend = u32(image.vpixel);
+
+   const int nvisible = int(bvh.visible.size());  // int, for OpenMP
+   #ifdef _OPENMP
+      #pragma omp parallel for
+   #endif
+   for (int n = 0;  n < nvisible;  ++n)
+      hprocess(light, engine, vars,
+               *bvh.visible[ulong(n)], screen, object_border);
+
+   for (ulong n = 0;  n < bvh.unbounded.size();  ++n)
+      hprocess(light, engine, vars,
+               bvh.unbounded[n], screen, object_border);
+}
+
+
+
+// -----------------------------------------------------------------------------
+// hfirst
+// Nearest intersection along a ray; returns nullptr if none
+// -----------------------------------------------------------------------------
+
+// hfirst_prim
+template<class real, class base>
+inline bool hfirst_prim(
+   const bvh_prim<real,base> &p, const eyetardiff<real> &etd,
+   const u32 i, const u32 j, const ulong zone,
+   const real qmin, inq<real,base> &q
+) {
+   if (!(p.active && inbound(*p.shape,i,j) &&
+         p.shape->infirst(
+            etd, subinfo(i,j,unsigned(zone),p.shape->mend), qmin, q)))
+      return false;
+   q.top = p.shape;
+   return true;
+}
+
+// hfirst_visit: for hwalk()
+template<class real, class base>
+class hfirst_visit {
+   const bvh_t<real,base> &bvh;
+   const eyetardiff<real> &etd;
+   const point<real> &inv;
+   const u32 i, j;
+   const ulong zone;
+
+public:
+   inq<real,base> *qa_ptr, *qb_ptr;  // qa_ptr: nearest so far
+   bool found;
+
+   explicit hfirst_visit(
+      const bvh_t<real,base> &_bvh, const eyetardiff<real> &_etd,
+      const point<real> &_inv,
+      const u32 _i, const u32 _j, const ulong _zone,
+      inq<real,base> &qa, inq<real,base> &qb
+   ) :
+      bvh(_bvh), etd(_etd), inv(_inv), i(_i), j(_j), zone(_zone),
+      qa_ptr(&qa), qb_ptr(&qb), found(false)
+   { }
+
+   // culled nodes weren't processed this frame
+   bool skip(const bvh_node<real> &node) const
+      { return node.frame != bvh.frame; }
+
+   // leaf
+   void operator()(const bvh_node<real> &leaf, real &qmin)
+   {
+      real tnear;
+      for (u32 n = leaf.first;  n < leaf.first+leaf.count;  ++n) {
+         const bvh_prim<real,base> &p = bvh.prim[n];
+         if (hslab(p.min, p.max, etd.eyeball, inv, qmin, tnear) &&
+             hfirst_prim(p, etd, i,j,zone, qmin, *qb_ptr)) {
+            std::swap(qa_ptr,qb_ptr);
+            qmin = real(*qa_ptr);
+            found = true;
+         }
+      }
+   }
+};
+
+// hfirst
+template<class real, class base>
+const inq<real,base> *hfirst(
+   const bvh_t<real,base> &bvh, const eyetardiff<real> &etd,
+   const u32 i, const u32 j, const ulong zone,
+   inq<real,base> &qa, inq<real,base> &qb
+) {
+   // ray: eyeball + t*dir, where dir = -diff
+   const point<real> inv(
+      hinverse(-etd.diff.x), hinverse(-etd.diff.y), hinverse(-etd.diff.z));
+   hfirst_visit<real,base> visit(bvh, etd, inv, i,j,zone, qa,qb);
+   real qmin = std::numeric_limits<real>::max();
+
+   // unbounded shapes
+   for (ulong n = 0;  n < bvh.unbounded.size();  ++n)
+      if (hfirst_prim(bvh.unbounded[n], etd, i,j,zone, qmin, *visit.qb_ptr)) {
+         std::swap(visit.qa_ptr,visit.qb_ptr);
+         qmin = real(*visit.qa_ptr);
+         visit.found = true;
+      }
+
+   // bounded shapes
+   hwalk(bvh.node, etd.eyeball, inv, qmin, visit);
+   return visit.found ? visit.qa_ptr : nullptr;
+}
+
+
+
+// -----------------------------------------------------------------------------
+// htrace_zone
+// Trace the pixels of one tile. ACC is bvh_t or block_t, for which hfirst()
+// has an overload.
+// -----------------------------------------------------------------------------
+
+template<class ACC, class real, class base, class color, class pix>
+void htrace_zone(
+   const ACC &acc,
+   const view  <real      > &view,
+   const light <real      > &light,
+   const vars  <real,base > &vars,
+         image <real,color> &image,
+         array <2,pix     > &pixel,
+   const u32 imin, const u32 iend,
+   const u32 jmin, const u32 jend, const ulong zone
+) {
+   inq<real,base> qa, qb;
+
+   if (image.anti < 2) {
+      // One-ray-per-pixel case
+      const real hmin = vars.hhalf - vars.hmax;
+      const real vmin = vars.vhalf - vars.vmax, dsq = view.d*view.d;
+
+      for (u32 j = jmin;  j < jend;  ++j) {
+         if (vars.stop()) return;  // cancelled, or out of time
+         const real v = vmin + real(j   )*vars.vfull, tmp = dsq + v*v;
+         /* */ real h = hmin + real(imin)*vars.hfull;
+         color *ptr = &image(imin,j);
+         pix   *p   = &pixel(imin,j);
+
+         for (u32 i = imin;  i < iend;  ++i, h += vars.hfull, ++ptr, ++p) {
+            if (vars.skip(i,j)) continue;
+            afew_arena::reset();
+
+            // a=(d,0,0), b=(0,h,v), (x,y,z)=a+(b-a)/mod(b-a)
+            const real norm = 1/std::sqrt(tmp + h*h);
+            const point<real> target =
+               vars.t2e.back(view.d*(1-norm), h*norm, v*norm);
+            const eyetardiff<real> etd(
+               vars.eyeball, target, vars.eyeball-target);
+
+            const inq<real,base> *const q =
+               hfirst(acc, etd, i, j, zone, qa, qb);
+            if (q)
+               *ptr = pixel_color<color>(vars.eyeball, light[0], *q, *p);
+         }
+      }
+
+   } else {
+      // Antialiasing case; same subpixel rays as in one_anti() et al.
+      const real hcent = real(imin)*vars.hfull - vars.hmax + vars.hhalf;
+      /* */ real v     = real(jmin)*vars.vfull - vars.vmax + vars.vhalf;
+
+      for (u32 j = jmin;  j < jend;  ++j, v += vars.vfull) {
+         if (vars.stop()) return;
+         real h = hcent;
+         color *ptr = &image(imin,j);
+         pix   *p   = &pixel(imin,j);
+
+         for (u32 i = imin;  i < iend;  ++i, h += vars.hfull, ++ptr, ++p) {
+            if (vars.adapt ? !vars.refine(i,j) : vars.skip(i,j)) continue;
+            afew_arena::reset();
+            RGBA<unsigned> sum(0,0,0);
+            bool found = false;
+
+            for (unsigned k = 0;  k < image.anti;  ++k)
+            for (unsigned l = 0;  l < image.anti;  ++l) {
+               const point<real> diff = normalize(
+                  vars.eyeball - vars.t2e.back_0nn(
+                     h-vars.hhalf+(vars.hhalf+real(k)*vars.hfull)*
+                        vars.rec_anti(real()),
+                     v-vars.vhalf+(vars.vhalf+real(l)*vars.vfull)*
+                        vars.rec_anti(real()))
+               ),
+               target = vars.eyeball - diff;
+               const eyetardiff<real> etd(vars.eyeball, target, diff);
+
+               const inq<real,base> *const q =
+                  hfirst(acc, etd, i, j, zone, qa, qb);
+               sum += q
+                  ? (found = true,
+                     pixel_color<color>(vars.eyeball, light[0], *q, *p))
+                  :  image.background;
+            }
+
+            if (found)
+               *ptr = op::div<uchar>(sum,vars.anti2);
+            else if (vars.adapt)
+               *ptr = image.background;
+         }
+      }
+   }
+}
+
+
+
+// -----------------------------------------------------------------------------
+// htrace
+// Ray trace, using bvh or block method. Tiles are laid out as the uniform
+// method's bins are, so that image.done, and with it cancellation and region-
+// of-interest handling, works per tile as it does for uniform. Surfs, here as
+// anywhere, trace their tris through their own hierarchies, not by zone.
+// -----------------------------------------------------------------------------
+
+template<class ACC, class real, class base, class color, class pix>
+void htrace(
+   const ACC &acc,
+   const view  <real      > &view,
+   const light <real      > &light,
+   const engine<real      > &engine,
+   const vars  <real,base > &vars,
+         image <real,color> &image,
+         array <2,pix     > &pixel
+) {
+   const ulong nzone = engine.hzone*engine.vzone;
+
+   #if defined(_OPENMP)
+      #pragma omp parallel for schedule(dynamic)
+   #endif
+   for (ulong zone = 0;  zone < nzone;  ++zone) {
+      u32
+         imin = op::round<u32>(vars.hrat*real (zone%engine.hzone)),
+         iend = op::round<u32>(vars.hrat*real((zone%engine.hzone)+1)),
+         jmin = op::round<u32>(vars.vrat*real (zone/engine.hzone)),
+         jend = op::round<u32>(vars.vrat*real((zone/engine.hzone)+1));
+
+      // region of interest
+      if (!vars.clip_roi(imin,iend, jmin,jend)) continue;
+
+      if (!vars.stop())
+         htrace_zone(
+            acc, view, light, vars, image, pixel, imin,iend, jmin,jend, zone);
+      if (vars.stopped)
+         image.done[zone] = 0;
+   }
+}
+
+} // namespace detail
@@ -161,6 +161,8 @@ inline bool inbound(
 //    get_first
 // This serves essentially as a middleman between one of our several *_plain
 // and *_anti functions below, and an individual shape's infirst() function.
+// On a hit, q.top is set to the bin's shape, which q.shape may be a part of,
+// e.g. for a surf's tri.
 // -----------------------------------------------------------------------------
 
 template<class BIN, class real, class tag>
@@ -185,6 +187,7 @@ inline bool get_first(
          num = 0;
 
       if (obj.infirst(etd, subinfo(i,j,unsigned(zone),obj.mend), qmin, q)) {
+         q.top = &obj;
          q = real(q)*(1 + eps*random_full<real>());
          return q < qmin*(1-eps)
             ? (num = 1)
@@ -193,7 +196,10 @@ inline bool get_first(
 
       return false;
    #else
-      return obj.infirst(etd, subinfo(i,j,unsigned(zone),obj.mend), qmin, q);
+      if (!obj.infirst(etd, subinfo(i,j,unsigned(zone),obj.mend), qmin, q))
+         return false;
+      q.top = &obj;
+      return true;
    #endif
 }
 
@@ -662,7 +668,9 @@ public:
          const eyetardiff<real> etd(vars.eyeball, target, diff);
 
          // loop over objects in this bin
-         unsigned s = 0;  bool f = false;
+         // *qa_ptr = maximum, or later comparisons see a stale (or, in the
+         // bin's first pixel, uninitialized) value if [0,endsorted) has no hit
+         unsigned s = 0;  bool f = false;  *qa_ptr = maximum;
          for ( ;  s < endsorted;  ++s)
             if (get_first(bin, s, i, j, zone, etd, maximum, *qb_ptr))
                { std::swap(qa_ptr,qb_ptr);  f = true;  s++;  break; }
@@ -704,7 +712,8 @@ public:
 // fill_loop_lean (like fill_loop_plain, sans image.prior.targets)
 // fill_loop_anti
 //
-// Loop over pixels i,j with indices [imin,iend) x [jmin,jend)
+// Loop over pixels i,j with indices [imin,iend) x [jmin,jend). Each returns
+// early, before a row, if the trace is cancelled or out of time; see stop().
 // -----------------------------------------------------------------------------
 
 // fill_loop_plain
@@ -736,12 +745,15 @@ inline void fill_loop_plain(
 ) {
    // vertical pixels in the current bin...
    for (u32 j = jmin;  j < jend;  ++j) {
+      if (vars.stop()) return;  // cancelled, or out of time
       const point<real> *tar = &image.prior.targets(imin,j);
       color *ptr = &image(imin,j);  unsigned prev = 0;
       pix *p = &pixel(imin,j);
 
       // horizontal pixels in the current bin...
       for (u32 i = imin;  i < iend;  ++i, ++tar, ++ptr, ++p) {
+         if (vars.skip(i,j)) continue;
+         afew_arena::reset();  // this pixel's afews start anew
          const point<real> target = vars.t2e.back(*tar);
 
          // action(individual pixel)
@@ -794,6 +806,7 @@ inline void fill_loop_lean(
 
    // vertical pixels in the current bin...
    for (u32 j = jmin;  j < jend;  ++j) {
+      if (vars.stop()) return;
       const real v = vmin + real(j   )*vars.vfull, tmp = dsq + v*v;
       /* */ real h = hmin + real(imin)*vars.hfull;
       color *ptr = &image(imin,j);  unsigned prev = 0;
@@ -801,6 +814,9 @@ inline void fill_loop_lean(
 
       // horizontal pixels in the current bin...
       for (u32 i = imin;  i < iend;  ++i, h += vars.hfull, ++ptr, ++p) {
+         if (vars.skip(i,j)) continue;
+         afew_arena::reset();
+
          // a=(d,0,0), b=(0,h,v), (x,y,z)=a+(b-a)/mod(b-a)
          const real norm = 1/std::sqrt(tmp + h*h);
          const point<real> target =
@@ -854,11 +870,14 @@ inline void fill_loop_anti(
 
    // vertical pixels in the current bin...
    for (u32 j = jmin;  j < jend;  ++j, v += vars.vfull, h = hcent) {
+      if (vars.stop()) return;
       color *ptr = &image(imin,j);
       pix   *p   = &pixel(imin,j);
 
       // horizontal pixels in the current bin...
       for (u32 i = imin;  i < iend;  ++i, h += vars.hfull, ++ptr, ++p) {
+         if (vars.adapt ? !vars.refine(i,j) : vars.skip(i,j)) continue;
+         afew_arena::reset();
          RGBA<unsigned> sum(0,0,0);  // qqq don't hardcode RGBA, here/elsewhere
 
          // one_anti()
@@ -872,6 +891,8 @@ inline void fill_loop_anti(
             i, j, zone
          ))
             *ptr = op::div<uchar>(sum,vars.anti2);
+         else if (vars.adapt)
+            *ptr = image.background;  // as if we'd antialiased from the start
       }
    }
 }
@@ -894,6 +915,27 @@ inline void bin_border(
    for (u32 i=imin; i<iend; ++i) image(i,jmin) = image(i,jend-1) = border;
 }
 
+// bin_border, with a region of interest
+// Just the part of the border that's in the region, if there is one
+template<class real, class base, class color>
+inline void bin_border(
+   image<real,color> &image, const vars<real,base> &vars,
+   const u32 imin, const u32 iend,
+   const u32 jmin, const u32 jend, const color &border
+) {
+   if (!vars.clip)
+      return bin_border(image, imin,iend, jmin,jend, border);
+
+   for (u32 j = jmin;  j < jend;  ++j) {
+      if (vars.inroi(imin,  j)) image(imin,  j) = border;
+      if (vars.inroi(iend-1,j)) image(iend-1,j) = border;
+   }
+   for (u32 i = imin;  i < iend;  ++i) {
+      if (vars.inroi(i,jmin  )) image(i,jmin  ) = border;
+      if (vars.inroi(i,jend-1)) image(i,jend-1) = border;
+   }
+}
+
 
 
 // trace_bin
@@ -907,6 +949,13 @@ inline void bin_border(
 // The "actual work" in this context consists of completing the pixels in this
 // bin, i.e. placing colors into them (and possibly drawing a border, if the
 // requisite flag is set).
+//
+// If piece, then [imin,iend) x [jmin,jend) is only part of the bin, whose
+// border (if any) has been drawn, and which has been fully sorted, by the
+// caller. Several pieces of one bin can then be traced at once, as nothing
+// here modifies the bin. See utrace_helper. Otherwise, it's the whole bin,
+// which, with a region of interest, is narrowed to the region after the border
+// is drawn; a border should be where the bin's edges are, not the region's.
 
 template<class real, class base, class color, class pix>
 void trace_bin(
@@ -919,25 +968,30 @@ void trace_bin(
    u32 imin, u32 iend,
    u32 jmin, u32 jend,
    const ulong zone, const ulong max_binsize,
-   std::vector<minimum_and_ptr<real,shape<real,base>>> &bin
+   std::vector<minimum_and_ptr<real,shape<real,base>>> &bin,
+   const bool piece = false
 ) {
    const ulong binsize = bin.size();
 
    // border?
    // If so, then draw the bin's border and squeeze in its bounds - which no
    // longer need to be ray-traced, because we just put the border into them!
-   if (image.border.bin)
+   if (image.border.bin && !piece)
       bin_border(
-         image, imin++,iend--, jmin++,jend--,
+         image, vars, imin++,iend--, jmin++,jend--,
          color::border(binsize, max_binsize)
       );
+   if (!piece && !vars.clip_roi(imin,iend, jmin,jend))
+      return;
 
    // binsize-dependent [partial-]sorting actions
    using diff_t =
       typename std::vector<minimum_and_ptr<real,shape<real,base>>>::difference_type;
    ulong endsorted = binsize; // for now
 
-   if (binsize == 2) {
+   if (piece) {
+      // already sorted
+   } else if (binsize == 2) {
       if (bin[1].min < bin[0].min)
          std::swap(bin[0], bin[1]);
    } else if (binsize > 2) {
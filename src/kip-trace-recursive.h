@@ -99,20 +99,20 @@ void rsetup(
    const engine<real     > &engine,
          vars  <real,base> &vars, shape_vectors<real,base> &sv
 ) {
-   // Target rectangle: [-hmax,+hmax] x [-vmax,+vmax]
+   // Target rectangle: [-hmax,+hend] x [-vmax,+vend]
 
    // Build left, right, bottom, and top segmenters
    vars.left   = dry_w(vars, -vars.hmax);
-   vars.right  = dry_e(vars,  vars.hmax);
+   vars.right  = dry_e(vars,  vars.hend);
    vars.bottom = dry_s(vars, -vars.vmax);
-   vars.top    = dry_n(vars,  vars.vmax);
+   vars.top    = dry_n(vars,  vars.vend);
 
    // Build diagonal segmenters
    if_segmenting_diag(
       vars.seg_diag.upsize(4);
-      vars.seg_diag[0] = dry_nw(vars, -vars.hmax,  vars.vmax);
-      vars.seg_diag[1] = dry_ne(vars,  vars.hmax,  vars.vmax);
-      vars.seg_diag[2] = dry_se(vars,  vars.hmax, -vars.vmax);
+      vars.seg_diag[0] = dry_nw(vars, -vars.hmax,  vars.vend);
+      vars.seg_diag[1] = dry_ne(vars,  vars.hend,  vars.vend);
+      vars.seg_diag[2] = dry_se(vars,  vars.hend, -vars.vmax);
       vars.seg_diag[3] = dry_sw(vars, -vars.hmax, -vars.vmax);
    )
 
@@ -430,6 +430,80 @@ inline void merge_bins(
 
 
 
+// -----------------------------------------------------------------------------
+// ubin
+// Process one shape, and drop it into the bins that it may cover, among
+// vms[0..nbin). Returns false if it's behind us, off-screen, or we're inside
+// it, so that it's in no bins; otherwise, bin is the range of bins.
+// -----------------------------------------------------------------------------
+
+template<class real, class base, class SHAPE>
+inline bool ubin(
+   const light<real> &light,
+   const engine<real> &engine,
+   vars<real,base> &vars,
+   SHAPE &shape,
+   const bool diag,
+   std::vector<minimum_and_ptr<real,kip::shape<real,base>>> *const vms,
+   minend &bin
+) {
+   // minimum distance from eyeball
+   shape.isoperand = false;  // or we wouldn't be in the shape vector
+   const real pmin = shape.SHAPE::process(vars.eyeball,light[0],engine,vars);
+   kip_assert(pmin >= 0);
+
+   // behind us, off-screen, or we're inside
+   minend sub;
+   if (shape.SHAPE::dry(vars.behind) ||
+      !seg_minmax(engine,vars,shape, sub.imin,sub.iend,sub.jmin,sub.jend) ||
+      (shape.interior && shape.solid))
+      return false;
+
+   // fine boundaries (used later, when shooting rays)
+   shape.mend.imin = op::round<u32>(vars.hratsub * real(sub.imin));
+   shape.mend.iend = op::round<u32>(vars.hratsub * real(sub.iend));
+   shape.mend.jmin = op::round<u32>(vars.vratsub * real(sub.jmin));
+   shape.mend.jend = op::round<u32>(vars.vratsub * real(sub.jend));
+
+   // outside the region of interest
+   if (vars.clip &&
+      (shape.mend.iend <= vars.roi.imin || vars.roi.iend <= shape.mend.imin ||
+       shape.mend.jend <= vars.roi.jmin || vars.roi.jend <= shape.mend.jmin))
+      return false;
+
+   // coarse bins (used shortly, when binning objects)
+   bin.imin =  sub.imin / engine.hsub;
+   bin.iend = (sub.iend + engine.hsub - 1)/engine.hsub;
+   bin.jmin =  sub.jmin / engine.vsub;
+   bin.jend = (sub.jend + engine.vsub - 1)/engine.vsub;
+   minend b = bin;  // test_diag() may change this
+
+   // drop into bins
+   for (u32 vseg = b.jmin;  vseg < b.jend;  ++vseg) {
+      ulong val = vseg*engine.hzone + b.imin;
+
+      for (u32 hseg = b.imin;  hseg < b.iend;  ++hseg, ++val) {
+         // diag?
+         if (diag) {
+            const char rv = test_diag(vars, shape, val, b, hseg);
+            if (rv == 'b') break;
+            if (rv == 'c') continue;
+         }
+
+         // quad, 3060, 1575?
+         if (test_quad(vars, shape, val) == 'c' ||
+             test_3060(vars, shape, val) == 'c' ||
+             test_1575(vars, shape, val) == 'c') continue;
+
+         // push to bin
+         vms[val].push_back(minimum_and_ptr<real,kip::shape<real,base>>(pmin,shape));
+      }
+   }
+   return true;
+}
+
+
+
 // -----------------------------------------------------------------------------
 // uprepare: general
 // -----------------------------------------------------------------------------
@@ -449,7 +523,8 @@ void uprepare(
    #ifdef _OPENMP
       // <3>: (hzone, vzone, nthreads-1)
       // nthreads-1 because thread 0 uses vars.uniform
-      static array<3,std::vector<minimum_and_ptr<real,shape<real,base>>>> per_zone;
+      array<3,std::vector<minimum_and_ptr<real,shape<real,base>>>> &per_zone =
+         vars.per_zone;
       const int nthreads = get_nthreads();
       for (ulong z = per_zone.size();  z--; )
          per_zone[z].clear();
@@ -465,33 +540,7 @@ void uprepare(
       #pragma omp parallel for
    #endif
    for (int i = 0;  i < numobj;  ++i) {
-      using SHAPE = typename SHAPEVEC::value_type;
-      SHAPE &shape = vec[ulong(i)];
-      if (!shape.on) continue;
-
-      // minimum distance from eyeball
-      shape.isoperand = false;  // or we wouldn't be in the shape vector
-      const real pmin = shape.SHAPE::process(vars.eyeball,light[0],engine,vars);
-      kip_assert(pmin >= 0);
-
-      // behind us, off-screen, or we're inside
-      minend sub, bin;
-      if (shape.SHAPE::dry(vars.behind) ||
-         !seg_minmax(engine,vars,shape, sub.imin,sub.iend,sub.jmin,sub.jend) ||
-         (shape.interior && shape.solid))
-         continue;
-
-      // fine boundaries (used later, when shooting rays)
-      shape.mend.imin = op::round<u32>(vars.hratsub * real(sub.imin));
-      shape.mend.iend = op::round<u32>(vars.hratsub * real(sub.iend));
-      shape.mend.jmin = op::round<u32>(vars.vratsub * real(sub.jmin));
-      shape.mend.jend = op::round<u32>(vars.vratsub * real(sub.jend));
-
-      // coarse bins (used shortly, when binning objects)
-      bin.imin =  sub.imin / engine.hsub;
-      bin.iend = (sub.iend + engine.hsub - 1)/engine.hsub;
-      bin.jmin =  sub.jmin / engine.vsub;
-      bin.jend = (sub.jend + engine.vsub - 1)/engine.vsub;
+      if (!vec[ulong(i)].on) continue;
 
       #ifdef _OPENMP
          const int thread = this_thread();
@@ -502,168 +551,8 @@ void uprepare(
          std::vector<minimum_and_ptr<real,kip::shape<real,base>>> *vms = &vars.uniform[0];
       #endif
 
-      // drop into bins
-      for (u32 vseg = bin.jmin;  vseg < bin.jend;  ++vseg) {
-         ulong val = vseg*engine.hzone + bin.imin;
-
-         for (u32 hseg = bin.imin;  hseg < bin.iend;  ++hseg, ++val) {
-            // diag?
-            if (diag) {
-               const char rv = test_diag(vars, shape, val, bin, hseg);
-               if (rv == 'b') break;
-               if (rv == 'c') continue;
-            }
-
-            // quad, 3060, 1575?
-            if (test_quad(vars, shape, val) == 'c' ||
-                test_3060(vars, shape, val) == 'c' ||
-                test_1575(vars, shape, val) == 'c') continue;
-
-            // push to bin
-            vms[val].push_back(minimum_and_ptr<real,kip::shape<real,base>>(pmin,shape));
-         }
-      }
-   }
-
-#ifdef _OPENMP
-   merge_bins(nbin, engine.hzone, vars, nthreads, per_zone);
-#endif
-}
-
-
-
-// -----------------------------------------------------------------------------
-// uprepare_tri
-// uprepare_surf
-// -----------------------------------------------------------------------------
-
-// uprepare_tri
-template<class element_t, class real, class base, class BINS>
-inline real uprepare_tri(
-   const engine<real> &engine, const vars<real,base> &vars,
-   BINS &bins, const surf<real,base> &surf, const bool object_border
-) {
-   real min_overall = std::numeric_limits<real>::max();
-
-   // per-node "behind" and "minend"
-   const ulong nnode = surf.node.size();
-   std::vector< bool > behind(nnode);
-   std::vector< minend > me(nnode);
-
-   // for each node...
-   for (ulong n = nnode;  n--; ) {
-      behind[n] = vars.behind.ge(surf.node[n]);
-      seg_minmax(
-         engine, vars, surf.node[n],
-         me[n].imin, me[n].iend,
-         me[n].jmin, me[n].jend
-      );
-   }
-
-   // for each tri
-   using tri_t = tri<real,base>;
-   for (ulong it = surf.tri.size();  it--; ) {
-      tri_t &t = surf.tri[it];  // this particular tri
-
-      // process
-      const real m = t.tri_t::process(surf.node, vars.eyeball, engine, vars);
-      const ulong u = t.u, v = t.v, w = t.w;
-
-      // degenerate / coplanar with eye, or entirely behind eye
-      if (t.degenerate || (behind[u] && behind[v] && behind[w])) continue;
-
-      // tri min and end, based on those of its vertices
-      const u32 imin = op::min(me[u].imin, me[v].imin, me[w].imin);
-      const u32 iend = op::max(me[u].iend, me[v].iend, me[w].iend);
-      const u32 jmin = op::min(me[u].jmin, me[v].jmin, me[w].jmin);
-      const u32 jend = op::max(me[u].jend, me[v].jend, me[w].jend);
-      if (imin == iend || jmin == jend) continue;
-
-      // fine boundaries
-      t.mend.imin = op::round<u32>(vars.hratsub * real(imin));
-      t.mend.iend = op::round<u32>(vars.hratsub * real(iend));
-      t.mend.jmin = op::round<u32>(vars.vratsub * real(jmin));
-      t.mend.jend = op::round<u32>(vars.vratsub * real(jend));
-
-      if (object_border) {
-         surf.mend.imin = op::min(surf.mend.imin, t.mend.imin);
-         surf.mend.iend = op::max(surf.mend.iend, t.mend.iend);
-         surf.mend.jmin = op::min(surf.mend.jmin, t.mend.jmin);
-         surf.mend.jend = op::max(surf.mend.jend, t.mend.jend);
-      }
-
-      // coarse bins
-      const u32 bimin =  imin / engine.hsub;
-      const u32 biend = (iend + engine.hsub - 1)/engine.hsub;
-      const u32 bjmin =  jmin / engine.vsub;
-      const u32 bjend = (jend + engine.vsub - 1)/engine.vsub;
-
-      // bring over base
-      t.base() = surf.base();
-
-      // drop into bins
-      for (u32 j = bjmin;  j < bjend;  ++j) {
-         u32 val = j*engine.hzone + bimin;
-         for (u32 i = bimin;  i < biend;  ++i)
-            bins[val++].push_back(element_t(m,t));
-      }
-
-      // overall minimum for the enclosing surf
-      if (m < min_overall) min_overall = m;
-   }
-
-   return min_overall;
-}
-
-
-
-// uprepare_surf
-template<class real, class base>
-inline void uprepare_surf(
-   const light<real> &light, const engine<real> &engine, vars<real,base> &vars,
-   const bool object_border, std::vector<surf<real,base>> &vec
-) {
-   // number of surfs
-   const int nsurf = int(vec.size());  // int, for OpenMP
-   if (nsurf == 0) return;
-
-   // per_zone(hzone, vzone, nthreads-1) (-1 because thread 0 uses vars.uniform)
-   static array<3,std::vector<minimum_and_ptr<real,shape<real,base>>>> per_zone;
-   #ifdef _OPENMP
-      const int nthreads = get_nthreads();
-      for (ulong z = per_zone.size();  z--; )
-         per_zone[z].clear();
-      if (nthreads > 1)
-         per_zone.resize(engine.hzone, engine.vzone, nthreads-1);
-   #endif
-
-   // for each surf...
-   const int nbin = int(engine.hzone * engine.vzone);
-   #ifdef _OPENMP
-      #pragma omp parallel for
-   #endif
-   for (int s = 0;  s < nsurf;  ++s) {
-      const surf<real,base> &p = vec[ulong(s)];  // this surf
-      if (!p.on) continue;
-
-      p.isoperand = false;  // global (not as operand) surf
-      p.surf<real,base>::process(vars.eyeball, light[0], engine, vars);
-      if ((p.interior && p.solid) || p.degenerate)
-         continue;
-
-      if (object_border ) {
-         p.mend.imin = std::numeric_limits<u32>::max();
-         p.mend.iend = std::numeric_limits<u32>::min();
-         p.mend.jmin = std::numeric_limits<u32>::max();
-         p.mend.jend = std::numeric_limits<u32>::min();
-      }
-
-      const int thread = this_thread();
-      std::vector<minimum_and_ptr<real,shape<real,base>>> *const ptr = thread
-       ? &per_zone[ulong(nbin*(thread-1))]
-       : &vars.uniform[0];
-      uprepare_tri<minimum_and_ptr<real,shape<real,base>>>
-         (engine,vars, ptr,p, object_border);
+      minend bin;
+      ubin(light, engine, vars, vec[ulong(i)], diag, vms, bin);
    }
 
 #ifdef _OPENMP
@@ -682,14 +571,13 @@ void usetup(
          model <real,base> &model,
    const light <real     > &light,
    const engine<real     > &engine,
-         vars  <real,base> &vars,
-   const bool object_border
+         vars  <real,base> &vars
 ) {
    // Build segmenters
    segment_h(engine,vars);
    segment_v(engine,vars); segment_various(engine,vars);
 
-   // Prepare most shapes
+   // Prepare shapes
    uprepare( light, engine, vars, model.kipnot,     true );
 
    uprepare( light, engine, vars, model.kipand,     true );
@@ -721,15 +609,156 @@ void usetup(
    uprepare( light, engine, vars, model.silo,       true );
    uprepare( light, engine, vars, model.sphere,     true );
    uprepare( light, engine, vars, model.spheroid,   true );
+   uprepare( light, engine, vars, model.surf,       true );
    uprepare( light, engine, vars, model.tabular,    true );
    uprepare( light, engine, vars, model.triangle,   true );
    uprepare( light, engine, vars, model.washer,     true );
    uprepare( light, engine, vars, model.xplane,     true );
    uprepare( light, engine, vars, model.yplane,     true );
    uprepare( light, engine, vars, model.zplane,     true );
+}
+
+
 
-   // Prepare surfs; creates "tri" objects
-   uprepare_surf(light, engine, vars, object_border, model.surf);
+// -----------------------------------------------------------------------------
+// ubounds
+// A bin's pixels
+// -----------------------------------------------------------------------------
+
+template<class real, class base>
+inline minend ubounds(
+   const engine<real> &engine, const vars<real,base> &vars, const ulong zone
+) {
+   // vars.hrat = real(image.hpixel) / real(engine.hzone)
+   // vars.vrat = real(image.vpixel) / real(engine.vzone)
+   minend b;
+   b.imin = op::round<u32>(vars.hrat*real (zone%engine.hzone));
+   b.iend = op::round<u32>(vars.hrat*real((zone%engine.hzone)+1));
+   b.jmin = op::round<u32>(vars.vrat*real (zone/engine.hzone));
+   b.jend = op::round<u32>(vars.vrat*real((zone/engine.hzone)+1));
+   return b;
+}
+
+
+
+// -----------------------------------------------------------------------------
+// urebin
+// For a partial frame; see trace_partial. Takes the changed shapes out of the
+// bins, and puts those that are still in the model back in. For each bin,
+// vars.redo becomes the rectangle around the pixels, in the bin, that those
+// shapes covered before (according to the change log), or cover now.
+// -----------------------------------------------------------------------------
+
+// redo_grow: grow redo to include the part of rect that's inside bounds
+inline void redo_grow(minend &redo, const minend &rect, const minend &bounds)
+{
+   const u32
+      imin = op::max(rect.imin, bounds.imin),
+      iend = op::min(rect.iend, bounds.iend),
+      jmin = op::max(rect.jmin, bounds.jmin),
+      jend = op::min(rect.jend, bounds.jend);
+   if (imin >= iend || jmin >= jend) return;
+
+   if (redo.imin >= redo.iend)
+      redo = minend{imin,iend, jmin,jend};
+   else {
+      redo.imin = op::min(redo.imin, imin);
+      redo.iend = op::max(redo.iend, iend);
+      redo.jmin = op::min(redo.jmin, jmin);
+      redo.jend = op::max(redo.jend, jend);
+   }
+}
+
+// dirty_t: changed shapes, sorted by pointer, each with its old rectangle
+template<class real, class base>
+using dirty_t = std::vector<std::pair<const shape<real,base> *, minend>>;
+
+// functor_rebin
+template<class real, class base>
+class functor_rebin {
+   const kip::light <real> &lig;
+   const kip::engine<real> &eng;
+   kip::detail::vars<real,base> &var;
+   const dirty_t<real,base> &dirty;
+
+public:
+   explicit functor_rebin(
+      const kip::light<real> &_light, const kip::engine<real> &_engine,
+      kip::detail::vars<real,base> &_vars, const dirty_t<real,base> &_dirty
+   ) : lig(_light), eng(_engine), var(_vars), dirty(_dirty) { }
+
+   template<class SHAPE>
+   void operator()(std::vector<SHAPE> &vec) const
+   {
+      if (vec.size() == 0) return;
+      using ptr_t = const shape<real,base> *;
+      const std::less<ptr_t> lt;
+
+      // the changed shapes that are in vec
+      auto it = std::lower_bound(
+         dirty.begin(), dirty.end(), ptr_t(&vec.front()),
+         [lt](const std::pair<ptr_t,minend> &d, const ptr_t p)
+            { return lt(d.first,p); }
+      );
+      for ( ;  it != dirty.end() && !lt(&vec.back(), it->first);  ++it) {
+         SHAPE &shape =
+            vec[ulong(static_cast<const SHAPE *>(it->first) - vec.data())];
+         minend bin;
+         if (!shape.on ||
+             !ubin(lig, eng, var, shape, true, &var.uniform[0], bin))
+            continue;
+
+         for (u32 vseg = bin.jmin;  vseg < bin.jend;  ++vseg)
+         for (u32 hseg = bin.imin;  hseg < bin.iend;  ++hseg) {
+            const ulong zone = vseg*eng.hzone + hseg;
+            redo_grow(var.redo[zone], shape.mend, ubounds(eng,var,zone));
+         }
+      }
+   }
+};
+
+// urebin
+template<class real, class base>
+void urebin(
+         model <real,base> &model,
+   const light <real     > &light,
+   const engine<real     > &engine,
+         vars  <real,base> &vars,
+   const dirty_t<real,base> &dirty
+) {
+   using ptr_t = const shape<real,base> *;
+   const int nzone = int(engine.hzone*engine.vzone);  // int, for OpenMP
+   vars.redo.assign(ulong(nzone), minend{0,0,0,0});
+   if (dirty.size() == 0) return;
+
+   // out
+   #ifdef _OPENMP
+      #pragma omp parallel for
+   #endif
+   for (int zone = 0;  zone < nzone;  ++zone) {
+      const ulong z = ulong(zone);
+      const minend bounds = ubounds(engine,vars,z);
+      std::vector<minimum_and_ptr<real,shape<real,base>>> &bin =
+         vars.uniform[z];
+      bin.erase(std::remove_if(bin.begin(), bin.end(),
+         [&](const minimum_and_ptr<real,shape<real,base>> &m)
+         {
+            const ptr_t p = m.shape;
+            const auto it = std::lower_bound(
+               dirty.begin(), dirty.end(), p,
+               [](const std::pair<ptr_t,minend> &d, const ptr_t q)
+                  { return std::less<ptr_t>()(d.first,q); }
+            );
+            if (it == dirty.end() || it->first != p) return false;
+            redo_grow(vars.redo[z], it->second, bounds);
+            return true;
+         }
+      ), bin.end());
+   }
+
+   // back in
+   const functor_rebin<real,base> f(light, engine, vars, dirty);
+   allshape(model, f);
 }
 
 
@@ -742,6 +771,33 @@ void usetup(
 
 template<class real, class tag, class color, class pix>
 class utrace_helper {
+
+   // tile
+   // A bin, or, if piece, rows [jmin,jend) of one; see trace_bin()
+   class tile {
+   public:
+      ulong zone;
+      u32 imin, iend, jmin, jend;
+      double cost;  // estimated
+      bool piece;
+   };
+
+   // bounds: a bin's pixels; in a partial frame, just those to be retraced.
+   // Returns false if there are none, or if none are in the region of interest.
+   // The bounds aren't narrowed to the region; trace_bin() does that, after it
+   // draws the bin's border, if any.
+   static bool bounds(
+      const engine<real> &engine, const vars<real,tag> &vars, const ulong zone,
+      u32 &imin, u32 &iend, u32 &jmin, u32 &jend
+   ) {
+      const minend b =
+         vars.partial ? vars.redo[zone] : ubounds(engine,vars,zone);
+      imin = b.imin;  iend = b.iend;
+      jmin = b.jmin;  jend = b.jend;
+      u32 imin_ = imin, iend_ = iend, jmin_ = jmin, jend_ = jend;
+      return vars.clip_roi(imin_,iend_, jmin_,jend_);
+   }
+
 public:
 
    // ------------------------
@@ -764,6 +820,11 @@ public:
          for (ulong zone = 0;  zone < nzone;  ++zone)
             max_binsize = std::max(max_binsize, vars.uniform[zone].size());
 
+      if (engine.steal) {
+         steal(nzone, max_binsize, view, light, engine, vars, image, pixel);
+         return;
+      }
+
       // Loop over the bins
       #if defined(_OPENMP)
          #pragma omp parallel for
@@ -773,24 +834,156 @@ public:
          if (binsize == 0 && !image.border.bin)
             continue;
 
-         // vars.hrat = real(image.hpixel) / real(engine.hzone)
-         // vars.vrat = real(image.vpixel) / real(engine.vzone)
-         const u32
-            imin = op::round<u32>(vars.hrat*real (zone%engine.hzone)),
-            iend = op::round<u32>(vars.hrat*real((zone%engine.hzone)+1)),
-            jmin = op::round<u32>(vars.vrat*real (zone/engine.hzone)),
-            jend = op::round<u32>(vars.vrat*real((zone/engine.hzone)+1));
+         u32 imin, iend, jmin, jend;
+         if (!bounds(engine, vars, zone, imin,iend, jmin,jend))
+            continue;
 
          if (binsize == 0)
-            bin_border(image,imin,iend,jmin,jend,color::border(0,max_binsize));
-         else
-            trace_bin(
-               engine, view, image, vars, light, pixel,
-               imin,iend, jmin,jend, zone, max_binsize,
-               vars.uniform[zone]
-            );
+            bin_border(
+               image, vars, imin,iend, jmin,jend, color::border(0,max_binsize));
+         else {
+            if (!vars.stop())
+               trace_bin(
+                  engine, view, image, vars, light, pixel,
+                  imin,iend, jmin,jend, zone, max_binsize,
+                  vars.uniform[zone]
+               );
+            if (vars.stopped)
+               image.done[zone] = 0;
+         }
       }
    }
+
+   // ------------------------
+   // steal
+   // ------------------------
+
+   // Like operator()'s loop over the bins, but with a steal_queue. The bins
+   // are dealt to the threads costliest first, where a bin's cost is taken to
+   // be its time in the previous frame, if we have that, or else its size
+   // times its number of pixels. A thread that takes a bin (or piece of one)
+   // whose cost is more than its share, or that takes anything while other
+   // threads are idle, splits the bin's rows in half, leaving one half to be
+   // stolen, until that's no longer the case.
+
+   void steal(
+      const ulong nzone, const ulong max_binsize,
+      const view  <real> &view,
+      const light <real> &light,
+      const engine<real> &engine,
+      vars <real,tag> &vars,
+      image<real,color> &image,
+      array<2,pix> &pixel
+   ) const {
+      // tiles, with estimated costs; a partial frame neither uses nor
+      // updates the measured ones, which are for whole bins
+      const bool measured = !vars.partial && vars.ucost.size() == nzone;
+      std::vector<tile> tiles;
+      double total = 0;
+
+      for (ulong zone = 0;  zone < nzone;  ++zone) {
+         const ulong binsize = vars.uniform[zone].size();
+         if (binsize == 0 && !image.border.bin)
+            continue;
+
+         tile t;  t.zone = zone;  t.piece = false;
+         if (!bounds(engine, vars, zone, t.imin,t.iend, t.jmin,t.jend))
+            continue;
+         t.cost = measured
+            ? vars.ucost[zone]
+            : double(binsize)*double(t.iend-t.imin)*double(t.jend-t.jmin);
+         total += t.cost;
+         tiles.push_back(t);
+      }
+      if (!vars.partial)
+         vars.ucost.assign(nzone, 0);
+
+      // costliest first, dealt round-robin
+      std::sort(
+         tiles.begin(), tiles.end(),
+         [](const tile &a, const tile &b) { return a.cost > b.cost; }
+      );
+      const unsigned nthreads = unsigned(get_nthreads());
+      steal_queue<tile> queue(nthreads);
+      for (ulong n = 0;  n < tiles.size();  ++n)
+         queue.push(unsigned(n % queue.size()), tiles[n]);
+
+      // a thread's share
+      const bool split = queue.size() > 1;
+      const double grain = total/double(8*queue.size());
+
+      const auto action = [&](tile t, const unsigned q)
+      {
+         std::vector<minimum_and_ptr<real,shape<real,tag>>> &bin =
+            vars.uniform[t.zone];
+         const ulong binsize = bin.size();
+
+         if (binsize == 0) {
+            bin_border(
+               image, vars, t.imin,t.iend, t.jmin,t.jend,
+               color::border(0,max_binsize));
+            return;
+         }
+         if (vars.stop()) {
+            #ifdef _OPENMP
+               #pragma omp atomic write
+            #endif
+            image.done[t.zone] = 0;
+            return;
+         }
+         const auto start = std::chrono::steady_clock::now();
+
+         // Whole bin, to be split? Then it must be bordered and sorted first,
+         // and only once; see trace_bin()
+         if (!t.piece && split && (t.cost > grain || queue.starving())) {
+            if (image.border.bin)
+               bin_border(
+                  image, vars, t.imin++,t.iend--, t.jmin++,t.jend--,
+                  color::border(binsize, max_binsize));
+            std::sort(bin.begin(), bin.end(), less<real,tag>());
+            t.piece = true;
+            if (!vars.clip_roi(t.imin,t.iend, t.jmin,t.jend))
+               return;
+         }
+
+         // split off halves, for others to steal
+         while (t.piece && t.jmin+2 <= t.jend &&
+               (t.cost > grain || queue.starving())) {
+            tile half = t;
+            half.jmin = t.jend = t.jmin + (t.jend-t.jmin)/2;
+            half.cost = t.cost /= 2;
+            queue.push(q, half);
+         }
+
+         trace_bin(
+            engine, view, image, vars, light, pixel,
+            t.imin,t.iend, t.jmin,t.jend, t.zone, max_binsize,
+            bin, t.piece
+         );
+         if (vars.stopped) {
+            // cut off, perhaps; pieces of a bin may be in several threads
+            #ifdef _OPENMP
+               #pragma omp atomic write
+            #endif
+            image.done[t.zone] = 0;
+         }
+
+         if (vars.partial) return;
+         const double seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+         #ifdef _OPENMP
+            #pragma omp atomic
+         #endif
+         vars.ucost[t.zone] += seconds;
+      };
+
+      #ifdef _OPENMP
+         #pragma omp parallel
+         queue.run(unsigned(this_thread()), action);
+      #else
+         queue.run(0, action);
+      #endif
+   }
 };
 
 
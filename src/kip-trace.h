@@ -10,6 +10,20 @@ inline void initialize_pixel(
 ) {
 }
 
+// initialize_one: pixel (i,j) of array<2,nothing_per_pixel>
+// no action
+inline void initialize_one(
+   array<2,nothing_per_pixel> &, const ulong, const ulong
+) {
+}
+
+// initialize_one: pixel (i,j) of array<2,pix>
+template<class pix>
+inline void initialize_one(array<2,pix> &pixel, const ulong i, const ulong j)
+{
+   pixel(i,j).initialize();
+}
+
 // initialize_pixel: array<2,pix>
 template<class pix>
 inline void initialize_pixel(
@@ -46,6 +60,29 @@ inline real angle_tweak(const real angle)
 
 
 
+// trace_anti
+// The parts of trace_vars() that depend on image.anti
+template<class base, class real, class color>
+inline void trace_anti(
+   const engine<real      > &engine,  // input
+   const image <real,color> &image,   // input
+         vars  <real,base > &vars     // auxiliary
+) {
+   // heps, veps: slightly less (based on the fudge factor) than the half-sizes
+   // of the antialiasing subpixels
+   vars.heps = engine.fudge * vars.hhalf / real(image.anti);
+   vars.veps = engine.fudge * vars.vhalf / real(image.anti);
+
+   // anti2
+   vars.anti2 = image.anti * image.anti;
+
+   // rec_anti*
+   vars.rec_anti (real ()) = 1/real (image.anti);
+   vars.rec_anti (float()) = 1/float(image.anti);
+}
+
+
+
 // trace_vars
 template<class base, class real, class color>
 inline void trace_vars(
@@ -82,18 +119,29 @@ inline void trace_vars(
    // eyeball
    vars.eyeball = vars.t2e.back_n00(view.d);
 
+   // For a tile, the whole image's size
+   const window_t &w = vars.window;
+   const ulong hwhole = w.on ? w.hpixel : hpixel;
+   const ulong vwhole = w.on ? w.vpixel : vpixel;
+
    // target rectangle: [-hmax,+hmax] x [-vmax,+vmax]
    vars.hmax = view.d * std::tan(view.fov * (pi<real>/360));
-   vars.vmax = image.aspect * real(vpixel)/real(hpixel) * vars.hmax;
+   vars.vmax = image.aspect * real(vwhole)/real(hwhole) * vars.hmax;
 
    // pixels: half & full sizes (remember, domain length is 2*max (-max..max))
-   vars.hhalf = vars.hmax/real(hpixel), vars.hfull = op::twice(vars.hhalf);
-   vars.vhalf = vars.vmax/real(vpixel), vars.vfull = op::twice(vars.vhalf);
+   vars.hhalf = vars.hmax/real(hwhole), vars.hfull = op::twice(vars.hhalf);
+   vars.vhalf = vars.vmax/real(vwhole), vars.vfull = op::twice(vars.vhalf);
 
-   // heps, veps: slightly less (based on the fudge factor) than the half-sizes
-   // of the antialiasing subpixels
-   vars.heps = engine.fudge * vars.hhalf / real(image.anti);
-   vars.veps = engine.fudge * vars.vhalf / real(image.anti);
+   // For a tile, just its part of the target rectangle
+   if (w.on) {
+      vars.hmax -= real(w.i)*vars.hfull;
+      vars.vmax -= real(w.j)*vars.vfull;
+   }
+   vars.hend = real(hpixel)*vars.hfull - vars.hmax;
+   vars.vend = real(vpixel)*vars.vfull - vars.vmax;
+
+   // heps, veps, anti2, rec_anti*
+   trace_anti(engine, image, vars);
 
    // behind: right-hand-rule thumb points behind eyeball
    vars.behind = rotate<3,real,op::part,op::unscaled>(
@@ -101,13 +149,6 @@ inline void trace_vars(
       vars.t2e.back_n01(view.d),  // up from eyeball
       vars.t2e.back_nm0(view.d)   // left of eyeball
    );
-
-   // anti2
-   vars.anti2 = image.anti * image.anti;
-
-   // rec_anti*
-   vars.rec_anti (real ()) = 1/real (image.anti);
-   vars.rec_anti (float()) = 1/float(image.anti);
 }
 
 
@@ -137,13 +178,17 @@ inline void trace_vipt(
    const bool new_vpixel = image.prior.first || vpixel   != image.prior.vpixel;
    const bool new_aspect = image.prior.first || aspect   != image.prior.aspect;
 
-   if (!(new_d || new_fov || new_hpixel || new_vpixel || new_aspect))
+   // A tile's targets depend on where it is; we don't keep track
+   const bool new_window = vars.window.on;
+
+   if (!(new_d || new_fov || new_hpixel || new_vpixel || new_aspect ||
+         new_window))
       return;
 
    // As necessary: (0,h,v), make distance=1 from (d,0,0), save new targets
    image.prior.targets.upsize(hpixel,vpixel);
 
-   if (!(new_fov || new_hpixel || new_vpixel || new_aspect)) {
+   if (!(new_fov || new_hpixel || new_vpixel || new_aspect || new_window)) {
       // new_d only
       const ulong npixel = hpixel*vpixel;
       const real diff_d = view.d - view.prior.d;
@@ -216,6 +261,517 @@ inline void trace_pixel(
 
 
 
+// trace_rect
+// Give the pixels in r the background color, and initialize their per-pixel
+// information; as trace_bitmap() and trace_pixel() do for all pixels
+template<class real, class color, class pix>
+inline void trace_rect(
+   image<real,color> &image,  // input/output
+   array<2,pix> &pixel,  // per-pixel information
+   const minend &r
+) {
+   const long jmin = long(r.jmin), jend = long(r.jend);  // long, for OpenMP
+   if (r.imin >= r.iend || jmin >= jend) return;
+
+   #ifdef _OPENMP
+      #pragma omp parallel for
+   #endif
+   for (long j = jmin;  j < jend;  ++j)
+   for (ulong i = r.imin;  i < r.iend;  ++i) {
+      image(i,ulong(j)) = image.background;
+      initialize_one(pixel, i, ulong(j));
+   }
+}
+
+
+
+// trace_refine
+// For adaptive antialiasing: mark the pixels whose color, after a one-ray-per-
+// pixel pass, differs from that of one of their eight neighbors by more than
+// image.contrast, in r, g, or b. With a region of interest, only the pixels,
+// and neighbors, in it; those outside weren't traced.
+template<class real, class base, class color>
+inline void trace_refine(
+   const image<real,color> &image,  // input
+   vars <real,base > &vars   // auxiliary
+) {
+   const long hpixel = long(image.hpixel);
+   const long vpixel = long(image.vpixel);
+   const int contrast = int(image.contrast);
+   vars.refine.upsize(ulong(hpixel), ulong(vpixel));
+
+   const long
+      ilo = vars.clip ? long(vars.roi.imin)   : 0,
+      ihi = vars.clip ? long(vars.roi.iend)-1 : hpixel-1,
+      jlo = vars.clip ? long(vars.roi.jmin)   : 0,
+      jhi = vars.clip ? long(vars.roi.jend)-1 : vpixel-1;
+
+   #ifdef _OPENMP
+      #pragma omp parallel for
+   #endif
+   for (long j = 0;  j < vpixel;  ++j)
+   for (long i = 0;  i < hpixel;  ++i) {
+      const color &c = image(ulong(i),ulong(j));
+      bool differ = false;
+
+      for (long b = op::max(j-1,jlo);  b <= op::min(j+1,jhi);  ++b)
+      for (long a = op::max(i-1,ilo);  a <= op::min(i+1,ihi);  ++a) {
+         const color &n = image(ulong(a),ulong(b));
+         differ = differ ||
+            std::abs(int(c.r) - int(n.r)) > contrast ||
+            std::abs(int(c.g) - int(n.g)) > contrast ||
+            std::abs(int(c.b) - int(n.b)) > contrast;
+      }
+
+      vars.refine(ulong(i),ulong(j)) = differ && !vars.skip(u32(i),u32(j));
+   }
+}
+
+
+
+// trace_done
+// Mark every tile as finished, until we learn otherwise; see image.done
+template<class real, class color>
+inline void trace_done(
+   const engine<real      > &engine,  // input
+         image <real,color> &image    // input/output
+) {
+   image.done.resize(engine.hzone, engine.vzone);
+   for (ulong n = image.done.size();  n--; )
+      image.done[n] = 1;
+}
+
+
+
+// trace_abandon
+// After a trace is cut off: give the pixels of the unfinished tiles the
+// background color. The recursive method doesn't trace by tile, so for it,
+// that's every pixel. With a region of interest, only pixels in it; the
+// others weren't ours to trace, and are left alone.
+template<class base, class real, class color, class pix>
+inline void trace_abandon(
+   const engine<real      > &engine,  // input
+         image <real,color> &image,   // input/output
+   array<2,pix> &pixel,               // per-pixel information
+   const vars  <real,base > &vars     // auxiliary
+) {
+   if (engine.method == method::recursive) {
+      for (ulong n = image.done.size();  n--; )
+         image.done[n] = 0;
+      if (vars.clip)
+         trace_rect(image, pixel, vars.roi);
+      else
+         trace_bitmap(image);
+      return;
+   }
+
+   const int nzone = int(image.done.size());  // int, for OpenMP
+   #ifdef _OPENMP
+      #pragma omp parallel for
+   #endif
+   for (int zone = 0;  zone < nzone;  ++zone) {
+      if (image.done[ulong(zone)]) continue;
+      const ulong z = ulong(zone);
+      u32
+         imin = op::round<u32>(vars.hrat*real (z%engine.hzone)),
+         iend = op::round<u32>(vars.hrat*real((z%engine.hzone)+1)),
+         jmin = op::round<u32>(vars.vrat*real (z/engine.hzone)),
+         jend = op::round<u32>(vars.vrat*real((z/engine.hzone)+1));
+      vars.clip_roi(imin,iend, jmin,jend);
+
+      for (u32 j = jmin;  j < jend;  ++j)
+      for (u32 i = imin;  i < iend;  ++i)
+         image(i,j) = image.background;
+   }
+}
+
+
+
+// trace_blocks
+// For progressive rendering, after a pass with the given stride: give each
+// pixel that wasn't traced the color of the one, at its block's corner, that
+// was. At least for display; trace_clear() undoes this before the next pass.
+template<class real, class color>
+inline void trace_blocks(image<real,color> &image, const u32 stride)
+{
+   const long hpixel = long(image.hpixel);
+   const long vpixel = long(image.vpixel);
+   const ulong mask = ~ulong(stride-1);
+
+   #ifdef _OPENMP
+      #pragma omp parallel for
+   #endif
+   for (long j = 0;  j < vpixel;  ++j)
+   for (long i = 0;  i < hpixel;  ++i)
+      if ((ulong(i) | ulong(j)) & (stride-1))
+         image(ulong(i),ulong(j)) = image(ulong(i) & mask, ulong(j) & mask);
+}
+
+
+
+// trace_clear
+// For progressive rendering, before a pass: give the pixels that the pass will
+// trace the background color, as trace_bitmap() did before the first pass
+template<class real, class base, class color>
+inline void trace_clear(
+   image<real,color> &image,  // input/output
+   const vars<real,base> &vars  // auxiliary
+) {
+   const long hpixel = long(image.hpixel);
+   const long vpixel = long(image.vpixel);
+
+   #ifdef _OPENMP
+      #pragma omp parallel for
+   #endif
+   for (long j = 0;  j < vpixel;  ++j)
+   for (long i = 0;  i < hpixel;  ++i)
+      if (!vars.skip(u32(i),u32(j)))
+         image(ulong(i),ulong(j)) = image.background;
+}
+
+
+
+// reproject_color
+// Color of a reused hit, with this frame's eyeball and light. As computed by
+// pixel_color(), but in world coordinates, as rhit::set() left the hit.
+template<class color, class real, class base>
+inline color reproject_color(
+   const point<real> &eyeball,
+   const point<real> &light,
+   const rhit<real,base> &hit
+) {
+   color out;
+   if (kip::flat) {
+      convert(*hit.color,out);
+      return out;
+   }
+
+   bool hilite = true;
+   const point<real> inter(hit.inter);
+   out = shape_color<color>(*hit.shape, *hit.color, inter, false, hilite);
+   if (!hilite) return out;
+
+   return highlight(
+      out, float(mod(eyeball - inter)),
+      point<float>(eyeball), point<float>(light),
+      hit.inter, hit.normal,
+      hit.isnormalized
+   );
+}
+
+
+
+// trace_reproject
+// If the last frame's hits are usable here (see engine.reproject), then warp
+// them into this view, give the pixels that can keep them their colors, and
+// mark those pixels in vars.reuse. Only the renderer's own per-pixel rhit
+// arrays have hits to warp; with any other per-pixel type, this does nothing.
+template<class base, class real, class color, class pix>
+inline void trace_reproject(
+   model<real,base> &, const view<real> &, const light<real> &,
+   const engine<real> &, image<real,color> &, vars<real,base> &,
+   array<2,pix> &, const unsigned
+) {
+}
+
+template<class base, class real, class color>
+void trace_reproject(
+         model <real,base > &model,   // input
+   const view  <real      > &view,    // input
+   const light <real      > &light,   // input
+   const engine<real      > &engine,  // input
+         image <real,color> &image,   // input/output
+         vars  <real,base > &vars,    // auxiliary
+         array<2,rhit<real,base>> &pixel,  // this frame's hits
+   const unsigned anti  // image.anti, which trace() may have changed
+) {
+   reproject_t<real,base> &rep = vars.reproject;
+   const ulong hpixel = image.hpixel;
+   const ulong vpixel = image.vpixel;
+
+   std::vector<std::pair<const void *, ulong>> sig;
+   hsignature(model, sig);
+
+   // Same model and image, and a small change of view?
+   const real deg = engine.reproject;
+   const bool small =
+      rep.valid && deg > 0 && anti == 1 && !vars.clip && !vars.window.on &&
+      engine.method != method::recursive &&
+      rep.image == &image && rep.hpixel == hpixel && rep.vpixel == vpixel &&
+      rep.aspect == image.aspect && rep.fov == view.fov &&
+      rep.target == view.target && rep.signature == sig &&
+      std::abs(view.theta - rep.theta) <= deg &&
+      std::abs(view.phi   - rep.phi  ) <= deg &&
+      std::abs(view.roll  - rep.roll ) <= deg &&
+      std::abs(view.d     - rep.d    ) <= deg*(pi<real>/180)*view.d;
+
+   // This frame, for the next; trace_remember() decides if it's valid
+   rep.valid  = false;
+   rep.image  = &image;
+   rep.hpixel = hpixel;  rep.vpixel = vpixel;
+   rep.aspect = image.aspect;
+   rep.fov    = view.fov;
+   rep.target = view.target;
+   rep.theta  = view.theta;  rep.phi = view.phi;  rep.roll = view.roll;
+   rep.d      = view.d;
+   rep.signature.swap(sig);
+   if (!small) return;
+
+   // Forward warp, keeping the nearest hit that lands at each pixel. In t2e's
+   // frame, the eyeball is at (d,0,0), and the screen is at x == 0.
+   const array<2,rhit<real,base>> &last = rep.hit[1-rep.now];
+   const ulong npixel = hpixel*vpixel;
+   const real hmin = vars.hhalf - vars.hmax;
+   const real vmin = vars.vhalf - vars.vmax;
+
+   rep.depth.upsize(hpixel,vpixel);
+   for (ulong n = 0;  n < npixel;  ++n)
+      rep.depth[n] = std::numeric_limits<real>::max();
+
+   for (ulong n = 0;  n < npixel;  ++n) {
+      if (!last[n].shape) continue;
+      const point<real> p = vars.t2e.fore(point<real>(last[n].inter));
+      const real depth = view.d - p.x;
+      if (!(depth > 0)) continue;
+
+      const real
+         i = std::floor((view.d*p.y/depth - hmin)/vars.hfull + real(0.5)),
+         j = std::floor((view.d*p.z/depth - vmin)/vars.vfull + real(0.5));
+      if (!(0 <= i && i < real(hpixel) && 0 <= j && j < real(vpixel)))
+         continue;
+
+      if (depth < rep.depth(ulong(i),ulong(j))) {
+         rep.depth(ulong(i),ulong(j)) = depth;
+         pixel(ulong(i),ulong(j)) = last[n];
+      }
+   }
+
+   // Reuse a hit only if the four neighboring pixels have hits on the same
+   // shape, at about the same depth. The same top-level shape, that is, so
+   // that neighboring pixels on different tris of one surf count. Others may
+   // be at an edge, or seen where a nearer surface, whose hits left a hole,
+   // should have hidden them.
+   vars.reuse.upsize(hpixel,vpixel);
+   const long ih = long(hpixel), jv = long(vpixel);  // long, for OpenMP
+
+   #ifdef _OPENMP
+      #pragma omp parallel for
+   #endif
+   for (long j = 0;  j < jv;  ++j)
+   for (long i = 0;  i < ih;  ++i) {
+      const ulong u = ulong(i), v = ulong(j);
+      const kip::shape<real,base> *const shape = pixel(u,v).shape;
+      const kip::shape<real,base> *const top = pixel(u,v).top;
+      const real depth = rep.depth(u,v), tol = depth/16;
+      const auto same = [&](const ulong a, const ulong b)
+      {
+         return pixel(a,b).shape && pixel(a,b).top == top &&
+            std::abs(rep.depth(a,b) - depth) <= tol;
+      };
+
+      vars.reuse(u,v) = shape &&
+         (i == 0    || same(u-1,v)) && (i == ih-1 || same(u+1,v)) &&
+         (j == 0    || same(u,v-1)) && (j == jv-1 || same(u,v+1));
+   }
+
+   #ifdef _OPENMP
+      #pragma omp parallel for
+   #endif
+   for (long n = 0;  n < long(npixel);  ++n)
+      if (vars.reuse[ulong(n)])
+         image.bitmap[ulong(n)] =
+            reproject_color<color>(vars.eyeball, light[0], pixel[ulong(n)]);
+      else
+         pixel[ulong(n)].shape = nullptr;
+
+   vars.reusing = true;
+}
+
+
+
+// trace_remember
+// Keep this frame's hits for the next, if they're all there, from one ray per
+// pixel; see trace_reproject
+template<class base, class real, class pix>
+inline void trace_remember(vars<real,base> &, array<2,pix> &, const bool)
+{
+}
+
+template<class base, class real>
+inline void trace_remember(
+   vars<real,base> &vars, array<2,rhit<real,base>> &, const bool usable
+) {
+   vars.reproject.valid = usable;
+   if (usable)
+      vars.reproject.now = 1 - vars.reproject.now;
+}
+
+
+
+// trace_carry
+// For a partial frame: if pixel is one of the renderer's rhit arrays, then
+// it's the one that the frame before last filled, so bring in the last
+// frame's hits. Returns false if they aren't all there.
+template<class base, class real, class pix>
+inline bool trace_carry(vars<real,base> &, array<2,pix> &)
+{
+   return true;
+}
+
+template<class base, class real>
+inline bool trace_carry(
+   vars<real,base> &vars, array<2,rhit<real,base>> &pixel
+) {
+   reproject_t<real,base> &rep = vars.reproject;
+   if (&pixel != &rep.hit[rep.now]) return true;
+   if (!rep.valid) return false;
+   const array<2,rhit<real,base>> &last = rep.hit[1-rep.now];
+   std::copy(last.data(), last.data() + last.size(), pixel.data());
+   return true;
+}
+
+// trace_pixkey: which per-pixel array, for uframe_t; the renderer's two
+// rhit arrays count as one
+template<class base, class real, class pix>
+inline const void *trace_pixkey(const vars<real,base> &, const array<2,pix> &p)
+{
+   return &p;
+}
+
+template<class base, class real>
+inline const void *trace_pixkey(
+   const vars<real,base> &vars, const array<2,rhit<real,base>> &pixel
+) {
+   const reproject_t<real,base> &rep = vars.reproject;
+   return &pixel == &rep.hit[0] || &pixel == &rep.hit[1]
+      ? (const void *)&rep : (const void *)&pixel;
+}
+
+// functor_data: the model's containers' data()
+class functor_data {
+   std::vector<const void *> &data;
+public:
+   explicit functor_data(std::vector<const void *> &_data) : data(_data) { }
+
+   template<class CONTAINER>
+   void operator()(const CONTAINER &c) const { data.push_back(c.data()); }
+};
+
+
+
+// trace_partial
+// For the uniform method. If, since the last frame, the only changes are to
+// shapes that the model logged (see model::changes), then re-bin just those
+// shapes, and give just the pixels around where they were, or are, the
+// background color; the uniform method then traces only those, and keeps
+// the rest of the image, and of the per-pixel array, from the last frame.
+// Otherwise, or if this isn't the uniform method, initialize all pixels.
+template<class base, class real, class color, class pix>
+void trace_partial(
+         model <real,base > &model,   // input
+   const view  <real      > &view,    // input
+   const light <real      > &light,   // input
+   const engine<real      > &engine,  // input
+         image <real,color> &image,   // input/output
+         vars  <real,base > &vars,    // auxiliary
+         array<2,pix>  &pixel,   // per-pixel information
+   const unsigned anti,  // image.anti, which trace() may have changed
+   const bool adapt
+) {
+   uframe_t<real> &last = vars.uframe;
+   vars.partial = false;
+
+   // This frame
+   const std::vector<real> param = {
+      view.target.x, view.target.y, view.target.z,
+      view.d, view.fov, view.theta, view.phi, view.roll,
+      light[0].x, light[0].y, light[0].z,
+      image.aspect, engine.fudge,
+      real(image.hpixel), real(image.vpixel), real(anti),
+      real(engine.hzone), real(engine.vzone),
+      real(engine.hsub), real(engine.vsub),
+      real(image.background.r),
+      real(image.background.g),
+      real(image.background.b)
+   };
+   std::vector<const void *> data;
+   const functor_data f(data);
+   allshape(model, f);
+
+   // Same as last frame's, except for logged changes to the model? There
+   // must be some; unlogged in-place changes don't move revision, and with
+   // nothing logged, we can't tell them from no changes at all.
+   bool same =
+      engine.incremental && last.valid &&
+      engine.method == method::uniform && !adapt &&
+      !vars.clip && !vars.window.on &&
+      !image.border.bin && !image.border.object &&
+      model.traced == &vars && last.model == &model &&
+      last.image == &image && last.pixel == trace_pixkey(vars,pixel) &&
+      last.param == param && last.data == data &&
+      model.revision > last.revision;
+   #ifdef KIP_ANGLE_TWEAK
+      same = false;  // the view is randomized, per frame
+   #endif
+
+   // The log must have every revision since last frame's; log[first...]
+   // are the changes
+   const std::vector<typename model<real,base>::change> &log = model.changes;
+   ulong first = log.size();
+   while (first && log[first-1].revision > last.revision)
+      --first;
+   if (same && model.revision != last.revision)
+      same = first < log.size() &&
+         log[first].revision == last.revision+1 &&
+         log.back().revision == model.revision;
+   for (ulong n = first+1;  same && n < log.size();  ++n)
+      same = log[n].revision - log[n-1].revision <= 1;
+   same = same && trace_carry(vars,pixel);
+
+   last.valid    = false;
+   last.model    = &model;
+   last.image    = &image;
+   last.pixel    = trace_pixkey(vars,pixel);
+   last.revision = model.revision;
+   last.param    = param;
+   last.data.swap(data);
+
+   if (!same) {
+      if (!vars.clip) {
+         trace_bitmap(image);
+         trace_pixel (image, pixel);
+      } else {
+         // just the region of interest, if the per-pixel array is the
+         // image's size already
+         if (pixel.isize() != image.hpixel || pixel.jsize() != image.vpixel)
+            trace_pixel(image, pixel);
+         trace_rect(image, pixel, vars.roi);
+      }
+      return;
+   }
+
+   // The changed shapes, each with its rectangle from before its first change
+   dirty_t<real,base> dirty;
+   dirty.reserve(log.size() - first);
+   for (ulong n = first;  n < log.size();  ++n)
+      dirty.push_back(std::make_pair(log[n].ptr, log[n].mend));
+   std::stable_sort(dirty.begin(), dirty.end(),
+      [](const auto &a, const auto &b)
+         { return std::less<const shape<real,base> *>()(a.first,b.first); });
+   dirty.erase(std::unique(dirty.begin(), dirty.end(),
+      [](const auto &a, const auto &b) { return a.first == b.first; }),
+      dirty.end());
+
+   urebin(model, light, engine, vars, dirty);
+   vars.partial = true;
+
+   // Background, in the rectangles to be retraced
+   for (ulong zone = 0;  zone < vars.redo.size();  ++zone)
+      trace_rect(image, pixel, vars.redo[zone]);
+}
+
+
+
 // object_border_shape, for object_border_begin
 template<class SHAPEVEC>
 inline void object_border_shape(const SHAPEVEC &shape)
@@ -243,9 +799,12 @@ inline void object_border_begin(
 
 
 // object_border_shape, for object_border_end
-template<class SHAPEVEC, class real, class color>
-inline void object_border_shape(const SHAPEVEC &shape, image<real,color> &image)
-{
+// With a region of interest, only the parts of borders that are in it
+template<class SHAPEVEC, class real, class color, class base>
+inline void object_border_shape(
+   const SHAPEVEC &shape, image<real,color> &image,
+   const vars<real,base> &vars
+) {
    // re: dotted-line computation
    const u32 small = image.border.small;
    const u32 large = image.border.large;
@@ -269,17 +828,17 @@ inline void object_border_shape(const SHAPEVEC &shape, image<real,color> &image)
             if ((i % large) < small) {
                convert(s.base(),out);
                //image(i,jmin)=image(i,jmax)=color(s.base());///color::border();
-               image(i,jmin) =
-               image(i,jmax) =
-                  out;///color(s.base());///color::border();
+               if (vars.inroi(i,jmin)) image(i,jmin) = out;
+               if (vars.inroi(i,jmax)) image(i,jmax) = out;
+               ///color(s.base());///color::border();
             }
          for (u32 j = jmin;  j < jend;  ++j)
             if ((j % large) < small) {
                convert(s.base(),out);
                //image(imin,j)=image(imax,j)=color(s.base());///color::border();
-               image(imin,j) =
-               image(imax,j) =
-                  out;///color(s.base());///color::border();
+               if (vars.inroi(imin,j)) image(imin,j) = out;
+               if (vars.inroi(imax,j)) image(imax,j) = out;
+               ///color(s.base());///color::border();
             }
       }
    }
@@ -289,10 +848,11 @@ inline void object_border_shape(const SHAPEVEC &shape, image<real,color> &image)
 template<class real, class base, class color>
 inline void object_border_end(
    const model<real,base> &model,
-   image<real,color> &image
+   image<real,color> &image,
+   const vars<real,base> &vars
 ) {
    if (image.border.object) {
-      #define kip_border(type) object_border_shape(model.type, image)
+      #define kip_border(type) object_border_shape(model.type, image, vars)
       kip_expand(kip_border,;)
       #undef kip_border
    }
@@ -316,6 +876,12 @@ inline void trace_uniform(
          vars  <real,base > &vars,    // auxiliary
          array<2,pix>  &pixel    // per-pixel information
 ) {
+   // partial frame: trace_partial has already updated the bins
+   if (vars.partial) {
+      utrace(view, light, engine, vars, image, pixel);
+      return;
+   }
+
    // clear *all* bins (each contains an array; could be lots of memory
    // waste if we cleared *only* up to the currently needed size)
    for (ulong b = vars.uniform.size();  b-- ; )
@@ -332,7 +898,7 @@ inline void trace_uniform(
    vars.vratsub = vars.vrat/real(engine.vsub);
 
    // preprocess, trace
-   usetup(model,       light, engine, vars, image.border.object);
+   usetup(model,       light, engine, vars);
    utrace(       view, light, engine, vars, image, pixel);
 }
 
@@ -350,13 +916,13 @@ inline void trace_recursive(
    const engine<real      > &engine,  // input
          image <real,color> &image,   // input/output
          vars  <real,base > &vars,    // auxiliary
+         shape_vectors<real,base> &sv, // auxiliary
          array<2,pix>  &pixel    // per-pixel information
 ) {
    const u32 hpixel = u32(image.hpixel);
    const u32 vpixel = u32(image.vpixel);
 
    // bookkeeping
-   static shape_vectors<real,base> sv;
    sv.clear();
    sv.reserve(model);
 
@@ -368,13 +934,40 @@ inline void trace_recursive(
    */
    rtrace(
       view, engine,image, vars,light, pixel,
-     -vars.hmax, vars.hmax, 0, hpixel,
-     -vars.vmax, vars.vmax, 0, vpixel, sv, true  // true = rootlevel
+     -vars.hmax, vars.hend, 0, hpixel,
+     -vars.vmax, vars.vend, 0, vpixel, sv, true  // true = rootlevel
    );
 }
 
 
 
+// -----------------------------------------------------------------------------
+// trace_bvh
+// -----------------------------------------------------------------------------
+
+template<class base, class real, class color, class pix>
+inline void trace_bvh(
+         model <real,base > &model,   // input
+   const view  <real      > &view,    // input
+   const light <real      > &light,   // input
+   const engine<real      > &engine,  // input
+         image <real,color> &image,   // input/output
+         vars  <real,base > &vars,    // auxiliary
+         array<2,pix>  &pixel    // per-pixel information
+) {
+   // compute vars.[hv]rat[sub]; tiles are laid out as uniform's bins are
+   vars.hrat = real(image.hpixel)/real(engine.hzone);
+   vars.vrat = real(image.vpixel)/real(engine.vzone);
+   vars.hratsub = vars.hrat/real(engine.hsub);
+   vars.vratsub = vars.vrat/real(engine.vsub);
+
+   // preprocess, trace
+   hsetup(model, light, engine, vars, image);
+   htrace(vars.bvh, view, light, engine, vars, image, pixel);
+}
+
+
+
 // -----------------------------------------------------------------------------
 // trace_block
 // -----------------------------------------------------------------------------
@@ -389,28 +982,56 @@ inline void trace_block(
          vars  <real,base > &vars,    // auxiliary
          array<2,pix>  &pixel    // per-pixel information
 ) {
-   (void)model;  (void)view;  (void)light;  (void)engine;
-   (void)image;  (void)vars;  (void)pixel;
-
-   // qqq This case needs lots of updating. We should have another boolean
-   // parameter, sent through the trace() functions, to indicate new scene.
-   // Also, we should have "first" to indicate first-time.
-   assert(false);
-
-   const ulong cap = vars.block.size();
-   if (cap == 0) {
-      // initialize block --- should just do once for a given model.
-      // qqq Do this better later; should check that size and xzone,
-      // yzone, and zzone are consistent if size != 0.
-      vars.block.resize(engine.xzone, engine.yzone, engine.zzone);
-      #ifdef KIP_BLOCK
-         bsetup(model, engine, vars);
-      #endif
-   }
+   // compute vars.[hv]rat[sub]; tiles are laid out as uniform's bins are
+   vars.hrat = real(image.hpixel)/real(engine.hzone);
+   vars.vrat = real(image.vpixel)/real(engine.vzone);
+   vars.hratsub = vars.hrat/real(engine.hsub);
+   vars.vratsub = vars.vrat/real(engine.vsub);
 
-   #ifdef KIP_BLOCK
-      btrace(model, view, light, engine, image, vars, pixel);
-   #endif
+   // preprocess, trace
+   bsetup(model, light, engine, vars, image);
+   htrace(vars.block, view, light, engine, vars, image, pixel);
+}
+
+
+
+// -----------------------------------------------------------------------------
+// trace_method
+// Preprocess and trace, by way of engine.method. If again, then preprocessing
+// from the previous call is still good (same model, view, and image.anti), so
+// we just trace; this is for progressive rendering's passes.
+// -----------------------------------------------------------------------------
+
+template<class base, class real, class color, class pix>
+inline void trace_method(
+         model <real,base > &model,   // input
+   const view  <real      > &view,    // input
+   const light <real      > &light,   // input
+   const engine<real      > &engine,  // input
+         image <real,color> &image,   // input/output
+         vars  <real,base > &vars,    // auxiliary
+         shape_vectors<real,base> &sv, // auxiliary, for recursive
+         array<2,pix>  &pixel,   // per-pixel information
+   const bool again
+) {
+   if (engine.method == method::uniform) {
+      if (again)
+         utrace(view, light, engine, vars, image, pixel);
+      else
+         trace_uniform(model,view,light,engine,image, vars,pixel);
+   } else if (engine.method == method::recursive)
+      trace_recursive(model,view,light,engine,image, vars,sv,pixel);
+   else if (engine.method == method::bvh) {
+      if (again)
+         htrace(vars.bvh, view, light, engine, vars, image, pixel);
+      else
+         trace_bvh(model,view,light,engine,image, vars,pixel);
+   } else {
+      if (again)
+         htrace(vars.block, view, light, engine, vars, image, pixel);
+      else
+         trace_block(model,view,light,engine,image, vars,pixel);
+   }
 }
 
 
@@ -427,34 +1048,372 @@ bool trace(
    const engine<real      > &engine,  // input
          image <real,color> &image,   // input/output
          vars  <real,base > &vars,    // auxiliary
-         array<2,pix>  &pixel    // per-pixel information
+         shape_vectors<real,base> &sv, // auxiliary, for recursive
+         array<2,pix>  &pixel,   // per-pixel information
+   const rect *const roi = nullptr  // region of interest, if any
 ) {
    // Set number of threads
    set_nthreads(get_nthreads());
 
+   // Region of interest, within the image
+   vars.clip = roi != nullptr;
+   if (vars.clip) {
+      vars.roi.imin = u32(op::min(roi->imin, image.hpixel));
+      vars.roi.iend = u32(op::min(roi->iend, image.hpixel));
+      vars.roi.jmin = u32(op::min(roi->jmin, image.vpixel));
+      vars.roi.jend = u32(op::min(roi->jend, image.vpixel));
+   }
+
+   // Progressive rendering: coarse passes, with one ray per pixel; then
+   // the final pass. Adaptive antialiasing: a final pass with one ray per
+   // pixel, then again, with antialiasing, but only for the pixels that
+   // trace_refine() marks.
+   const unsigned anti = image.anti;
+   const bool adapt = image.adaptive && anti > 1;
+   u32 coarse = engine.progressive;  // fix()ed: 0, or a power of 2
+   if (vars.clip || vars.window.on) coarse = 0;  // not for part of an image
+   if (adapt || coarse) image.anti = 1;
+   vars.adapt = false;
+   vars.stride = 1;
+   vars.prior  = 0;
+   vars.reusing = false;
+
+   // Cancellation
+   vars.cancel = engine.cancel;
+   vars.timed = engine.budget > 0;
+   if (vars.timed)
+      vars.deadline = std::chrono::steady_clock::now() +
+         std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(engine.budget));
+   vars.stopped = false;
+
    // Initializations
    trace_vars  (model, view, light, engine, image, vars);
    ///   trace_vipt  (model,view,light,engine,image, vars);
    trace_vipt  (view, engine, image, vars);
-   trace_bitmap(image);
-   trace_pixel (image, pixel);
+   trace_partial(model,view,light,engine,image, vars,pixel, anti,adapt);
+   trace_done  (engine, image);
+
+   // Reuse the last frame's hits, if possible; then there's no need for
+   // coarse passes. Nor for a partial frame.
+   trace_reproject(model,view,light,engine,image, vars,pixel, anti);
+   if (vars.reusing || vars.partial) coarse = 0;
 
    // Initialize object bounds, if appropriate
    object_border_begin(model,image);
 
-   // Select method...
-   if (engine.method == method::uniform)
-      trace_uniform  (model,view,light,engine,image, vars,pixel);
-   else if (engine.method == method::recursive)
-      trace_recursive(model,view,light,engine,image, vars,pixel);
-   else
-      trace_block    (model,view,light,engine,image, vars,pixel);
+   // Coarse passes, if progressive
+   bool again = false, complete = true;
+   for (u32 stride = coarse;  stride > 1;  stride /= 2, again = true) {
+      vars.stride = stride;
+      vars.prior  = again ? 2*stride : 0;
+      if (again) trace_clear(image, vars);
+      trace_method(model,view,light,engine,image, vars,sv,pixel, again);
+      if (vars.stopped) break;
+      trace_blocks(image, stride);
+
+      if (engine.progress && !engine.progress(stride)) {
+         complete = false;
+         break;
+      }
+   }
 
-   // Draw object bounds, if appropriate
-   object_border_end(model,image);
+   // Final pass; twice, if adapt. Without antialiasing, it traces only the
+   // pixels that coarse passes didn't.
+   if (complete) {
+      if (!adapt && image.anti != anti) {
+         image.anti = anti;
+         trace_anti(engine, image, vars);
+         again = false;
+      }
+      vars.stride = 1;
+      vars.prior  = coarse && image.anti == 1 ? 2 : 0;
+      if (coarse) trace_clear(image, vars);
+
+      for (unsigned pass = 0;  pass < 1u+adapt;  ++pass) {
+         if (pass == 1) {
+            vars.prior = 0;
+            image.anti = anti;
+            trace_anti(engine, image, vars);
+            trace_refine(image, vars);
+            vars.adapt = true;
+            again = false;
+         }
+         trace_method(model,view,light,engine,image, vars,sv,pixel, again);
+         if (vars.stopped) break;
+         again = true;
+      }
+   }
+
+   // Cancelled, or out of time?
+   if (vars.stopped) {
+      trace_abandon(engine, image, pixel, vars);
+      complete = false;
+   }
+
+   // Draw object bounds, if appropriate; before vars.clip is reset
+   object_border_end(model,image,vars);
+
+   trace_remember(vars, pixel,
+      complete && anti == 1 && !vars.clip && !vars.window.on);
+   vars.uframe.valid = complete && engine.method == method::uniform &&
+      !adapt && !vars.clip && !vars.window.on;
+   model.traced = engine.method == method::uniform ? &vars : nullptr;
+   vars.partial = false;
+   vars.clip = false;
+   image.anti = anti;
+   vars.adapt = false;
+   vars.stride = 1;
+   vars.prior  = 0;
+   vars.reusing = false;
 
    // Done
-   return true;
+   return complete;
+}
+
+} // namespace detail
+
+
+
+// -----------------------------------------------------------------------------
+// renderer
+// Owns the scratch state that tracing needs: vars (bins, hierarchies, etc.),
+// recursive's shape vectors, and a default per-pixel array. Each renderer is
+// independent of any other, so different threads can render at once, each
+// with its own renderer. Reusing a renderer from one call to the next reuses
+// its allocations, and, for bvh and block, its model-dependent structures.
+// -----------------------------------------------------------------------------
+
+template<class real = defaults::real, class base = defaults::base>
+class renderer {
+   detail::vars<real,base> vars;
+   detail::shape_vectors<real,base> sv;
+   array<2,nothing_per_pixel> nothing;
+
+   // trace_image: for trace(model, view, light, engine, image[, roi])
+   template<class color>
+   bool trace_image(
+            model <real,base > &model,   // input
+      const view  <real      > &view,    // input
+      const light <real      > &light,   // input
+      const engine<real      > &engine,  // input
+            image <real,color> &image,   // input/output
+      const rect *const roi
+   ) {
+      // With reprojection, our per-pixel array remembers the hits
+      if (engine.reproject > 0)
+         return detail::trace(
+            model,
+            view  .fix(),
+            light .fix(),
+            engine.fix(image.hpixel, image.vpixel),
+            image .fix(),
+            vars,
+            sv,
+            vars.reproject.hit[vars.reproject.now],
+            roi
+         );
+
+      return detail::trace(
+         model,  // has no fix()
+         view  .fix(),
+         light .fix(),
+         engine.fix(image.hpixel, image.vpixel),
+         image .fix(),
+         vars,   // has no fix()
+         sv,     // has no fix()
+         nothing,// has no fix()
+         roi
+      );
+   }
+
+public:
+
+   // trace(model, view, light, engine, image)
+   template<class color>
+   bool trace(
+            model <real,base > &model,   // input
+      const view  <real      > &view,    // input
+      const light <real      > &light,   // input
+      const engine<real      > &engine,  // input
+            image <real,color> &image    // input/output
+   ) {
+      return trace_image(model, view, light, engine, image, nullptr);
+   }
+
+   // trace(model, view, light, engine, image, roi)
+   // Traces only the pixels in roi, the region of interest, and leaves the
+   // rest of the image as it was. Only the shapes that overlap roi are binned
+   // (uniform), and only the tiles that overlap it are visited (bvh, block).
+   // For repainting just where a shape was, or is (see rect::grow()), or for
+   // rendering one tile of a larger image.
+   template<class color>
+   bool trace(
+            model <real,base > &model,   // input
+      const view  <real      > &view,    // input
+      const light <real      > &light,   // input
+      const engine<real      > &engine,  // input
+            image <real,color> &image,   // input/output
+      const rect &roi
+   ) {
+      return trace_image(model, view, light, engine, image, &roi);
+   }
+
+   // trace(model, view, light, engine, image, pixel)
+   template<class color, class pix>
+   bool trace(
+            model <real,base > &model,   // input
+      const view  <real      > &view,    // input
+      const light <real      > &light,   // input
+      const engine<real      > &engine,  // input
+            image <real,color> &image,   // input/output
+            array<2,pix>  &pixel    // per-pixel information
+   ) {
+      return detail::trace(
+         model,
+         view  .fix(),
+         light .fix(),
+         engine.fix(image.hpixel, image.vpixel),
+         image .fix(),
+         vars,
+         sv,
+         pixel
+      );
+   }
+
+   // trace(model, view, light, engine, image, pixel, roi)
+   template<class color, class pix>
+   bool trace(
+            model <real,base > &model,   // input
+      const view  <real      > &view,    // input
+      const light <real      > &light,   // input
+      const engine<real      > &engine,  // input
+            image <real,color> &image,   // input/output
+            array<2,pix>  &pixel,   // per-pixel information
+      const rect &roi
+   ) {
+      return detail::trace(
+         model,
+         view  .fix(),
+         light .fix(),
+         engine.fix(image.hpixel, image.vpixel),
+         image .fix(),
+         vars,
+         sv,
+         pixel,
+         &roi
+      );
+   }
+
+   // trace(scene[, roi])
+   template<class color>
+   bool trace(scene<real,base,color> &s)
+   {
+      return trace(s, s, s, s, s);
+   }
+
+   template<class color>
+   bool trace(scene<real,base,color> &s, const rect &roi)
+   {
+      return trace(s, s, s, s, s, roi);
+   }
+
+   // trace(scene, pixel[, roi])
+   template<class color, class pix>
+   bool trace(scene<real,base,color> &s, array<2,pix> &pixel)
+   {
+      return trace(s, s, s, s, s, pixel);
+   }
+
+   template<class color, class pix>
+   bool trace(scene<real,base,color> &s, array<2,pix> &pixel, const rect &roi)
+   {
+      return trace(s, s, s, s, s, pixel, roi);
+   }
+
+   // trace_tiled(model, view, light, engine, image, hpixel,vpixel, tile, sink)
+   // Renders an hpixel x vpixel image, as trace() would, but a tile at a time,
+   // so that neither it nor anything else of its size is ever allocated.
+   // image's settings (background, aspect, anti, etc.) are used; its bitmap is
+   // resized to each tile in turn, traced into, and handed to sink(image,i,j),
+   // where (i,j) is the whole image's pixel at which the tile begins. Tiles
+   // are tile x tile pixels, or smaller at the right and top edges, and come
+   // in bands, left to right, from the top band down, as image files' rows
+   // usually go; see image_writer. Stops, returning false, if a tile isn't
+   // finished (see engine.cancel and engine.budget), or if sink returns false.
+   template<class color, class SINK>
+   bool trace_tiled(
+            model <real,base > &model,   // input
+      const view  <real      > &view,    // input
+      const light <real      > &light,   // input
+      const engine<real      > &engine,  // input
+            image <real,color> &image,   // tile; input/output
+      const ulong hpixel, const ulong vpixel, const ulong tile,
+      SINK &&sink
+   ) {
+      const ulong size = op::max(tile, ulong(1));
+      bool okay = true;
+
+      for (ulong band = (vpixel+size-1)/size;  okay && band--; )
+      for (ulong i = 0;  okay && i < hpixel;  i += size) {
+         const ulong j = band*size;
+         image.upsize(op::min(size, hpixel-i), op::min(size, vpixel-j));
+         okay = trace_window(
+            model, view, light, engine, image, hpixel, vpixel, i, j) &&
+            sink(image, i, j);
+      }
+      return okay;
+   }
+
+   // trace_window(model, view, light, engine, image, hpixel,vpixel, i,j)
+   // Traces into image the tile, of image's size, that begins at pixel (i,j)
+   // of an hpixel x vpixel image. For trace_tiled(), and for farm workers.
+   template<class color>
+   bool trace_window(
+            model <real,base > &model,   // input
+      const view  <real      > &view,    // input
+      const light <real      > &light,   // input
+      const engine<real      > &engine,  // input
+            image <real,color> &image,   // tile; input/output
+      const ulong hpixel, const ulong vpixel, const ulong i, const ulong j
+   ) {
+      detail::window_t &w = vars.window;
+      w.on = true;
+      w.hpixel = hpixel;  w.i = i;
+      w.vpixel = vpixel;  w.j = j;
+      const bool okay = trace_image(model, view, light, engine, image, nullptr);
+      w.on = false;
+      return okay;
+   }
+
+   // trace_tiled(scene, hpixel,vpixel, tile, sink)
+   template<class color, class SINK>
+   bool trace_tiled(
+      scene<real,base,color> &s,
+      const ulong hpixel, const ulong vpixel, const ulong tile,
+      SINK &&sink
+   ) {
+      return trace_tiled(s, s, s, s, s, hpixel, vpixel, tile, sink);
+   }
+};
+
+
+
+// -----------------------------------------------------------------------------
+// thread_renderer
+// The calling thread's renderer, for the trace() and trace_tiled() below. One
+// for all of them, so that a thread that calls several, e.g. trace(...) and
+// trace(..., roi) in turn, keeps one set of bins, hierarchies, and per-pixel
+// buffers, rather than one per function.
+// -----------------------------------------------------------------------------
+
+namespace detail {
+
+template<class real, class base>
+inline renderer<real,base> &thread_renderer()
+{
+   static thread_local renderer<real,base> r;
+   return r;
 }
 
 } // namespace detail
@@ -463,6 +1422,9 @@ bool trace(
 
 // -----------------------------------------------------------------------------
 // trace (user-called)
+// Each calling thread has its own renderer, kept from one call to the next.
+// For more than one render at a time in a thread (say, of several models, or
+// views, whose bvh or block structures should each be kept), use renderers.
 // -----------------------------------------------------------------------------
 
 // trace(model, view, light, engine, image)
@@ -474,22 +1436,23 @@ inline bool trace(
    const engine<real      > &engine,  // input
          image <real,color> &image    // input/output
 ) {
-   static array<2,nothing_per_pixel> pixel;
-
-   // qqq Consider putting vars into another class, as "static" makes this
-   // particular function non-thread-safe. Then again, perhaps thread safety
-   // in this context isn't particularly important.
-   static detail::vars<real,base> vars;
-
-   return detail::trace(
-      model,  // has no fix()
-      view  .fix(),
-      light .fix(),
-      engine.fix(image.hpixel, image.vpixel),
-      image .fix(),
-      vars,   // has no fix()
-      pixel   // has no fix()
-   );
+   renderer<real,base> &r = detail::thread_renderer<real,base>();
+   return r.trace(model, view, light, engine, image);
+}
+
+// trace(model, view, light, engine, image, roi)
+// See renderer::trace(model, view, light, engine, image, roi)
+template<class real, class base, class color>
+inline bool trace(
+         model <real,base > &model,   // input
+   const view  <real      > &view,    // input
+   const light <real      > &light,   // input
+   const engine<real      > &engine,  // input
+         image <real,color> &image,   // input/output
+   const rect &roi
+) {
+   renderer<real,base> &r = detail::thread_renderer<real,base>();
+   return r.trace(model, view, light, engine, image, roi);
 }
 
 // trace(model, view, light, engine, image, pixel)
@@ -502,18 +1465,69 @@ inline bool trace(
          image <real,color> &image,   // input/output
          array<2,pix>  &pixel    // per-pixel information
 ) {
-   // qqq See above remark
-   static detail::vars<real,base> vars;
-
-   return detail::trace(
-      model,
-      view  .fix(),
-      light .fix(),
-      engine.fix(image.hpixel, image.vpixel),
-      image .fix(),
-      vars,
-      pixel
-   );
+   renderer<real,base> &r = detail::thread_renderer<real,base>();
+   return r.trace(model, view, light, engine, image, pixel);
+}
+
+
+
+// trace(model, views, light, engine, images)
+// Renders model from each views[n] into images[n]. Rather than tracing the
+// views one at a time, each with every thread, we deal the views out to the
+// threads. Each thread traces its views by itself, with its own renderer and
+// its own per-view copy of the model (see model::share()), so for many small
+// images the threads aren't left idle during the serial parts of each trace.
+// Those copies share only top-level surfs' geometry; everything else is
+// copied, once per thread, so for large models of other shapes, consider
+// tracing the views one at a time instead.
+template<class real, class base, class color>
+bool trace(
+         model <real,base > &model,   // input
+   const std::vector<view<real>> &views,   // input
+   const light <real      > &light,   // input
+   const engine<real      > &engine,  // input
+         std::vector<image<real,color>> &images  // input/output
+) {
+   if (views.size() != images.size()) {
+      std::ostringstream oss;
+      oss << "Batched trace() has " << views.size() << " views, but "
+          << images.size() << " images";
+      (void)error(oss);
+      return false;
+   }
+   if (views.size() == 1)
+      return trace(model, views[0], light, engine, images[0]);
+
+   const int nview = int(views.size());  // int, for OpenMP
+   bool okay = true;
+
+#ifdef _OPENMP
+   // parallelize across views, not within them
+   const int levels = omp_get_max_active_levels();
+   omp_set_max_active_levels(1);
+   #pragma omp parallel num_threads(get_nthreads()) reduction(&&:okay)
+#endif
+   {
+      // per-thread copy; the first share() builds the surfs' hierarchies
+      kip::model<real,base> copy;
+      #ifdef _OPENMP
+         #pragma omp critical
+      #endif
+      copy.share(model);
+      renderer<real,base> r;
+
+      #ifdef _OPENMP
+         #pragma omp for schedule(dynamic)
+      #endif
+      for (int n = 0;  n < nview;  ++n)
+         okay = r.trace(copy, views[ulong(n)], light, engine,
+                        images[ulong(n)]) && okay;
+   }
+
+#ifdef _OPENMP
+   omp_set_max_active_levels(levels);
+#endif
+   return okay;
 }
 
 
@@ -526,6 +1540,44 @@ inline bool trace(scene<real,base,color> &s)
    return trace(s, s, s, s, s);
 }
 
+// trace(scene,rect)
+template<class real, class base, class color>
+inline bool trace(scene<real,base,color> &s, const rect &roi)
+{
+   // model, view, light, engine, image, roi
+   return trace(s, s, s, s, s, roi);
+}
+
+
+
+// trace_tiled(model, view, light, engine, image, hpixel,vpixel, tile, sink)
+// See renderer::trace_tiled()
+template<class real, class base, class color, class SINK>
+inline bool trace_tiled(
+         model <real,base > &model,   // input
+   const view  <real      > &view,    // input
+   const light <real      > &light,   // input
+   const engine<real      > &engine,  // input
+         image <real,color> &image,   // tile; input/output
+   const ulong hpixel, const ulong vpixel, const ulong tile,
+   SINK &&sink
+) {
+   renderer<real,base> &r = detail::thread_renderer<real,base>();
+   return r.trace_tiled(
+      model, view, light, engine, image, hpixel, vpixel, tile, sink);
+}
+
+// trace_tiled(scene, hpixel,vpixel, tile, sink)
+template<class real, class base, class color, class SINK>
+inline bool trace_tiled(
+   scene<real,base,color> &s,
+   const ulong hpixel, const ulong vpixel, const ulong tile,
+   SINK &&sink
+) {
+   // model, view, light, engine, image, ...
+   return trace_tiled(s, s, s, s, s, hpixel, vpixel, tile, sink);
+}
+
 // trace(scene,array)
 template<class real, class base, class color, class pix>
 inline bool trace(scene<real,base,color> &s, array<2,pix> &pixel)
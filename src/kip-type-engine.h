@@ -29,12 +29,29 @@ public:
    unsigned hsub  = 0;
    unsigned vsub  = 0;
 
+   // If steal, then the bins are handed to threads by a work-stealing
+   // scheduler, costliest first (by their cost in the previous frame, if
+   // known), and a costly bin is split into pieces when other threads would
+   // otherwise be idle. If not, then by a plain omp parallel for.
+   bool steal = true;
+
    // For recursive
    unsigned hdivision = 2;
    unsigned vdivision = 2;
    unsigned min_area  = 800;
 
+   // For bvh
+   // The hierarchy is built over world-space bounding boxes, once per model,
+   // and reused across frames. leaf_size is the largest number of shapes in
+   // a leaf node. hzone and vzone (above) are reused as screen tiles, which
+   // are traced in parallel.
+   unsigned leaf_size = 4;
+
    // For block
+   // The grid is laid over the world-space bounding boxes of the model's
+   // shapes, once per model, and reused across frames. xzone, yzone, and
+   // zzone are the number of cells in each direction. As with bvh, hzone and
+   // vzone are reused as screen tiles.
    unsigned xzone = 26;
    unsigned yzone = 26;
    unsigned zzone = 26;
@@ -43,6 +60,49 @@ public:
    real     sort_frac = real(0.02);
    unsigned sort_min  = 64;
 
+   // For all methods: progressive rendering
+   // If progressive >= 2 (rounded down to a power of 2), then trace() first
+   // traces every progressive'th pixel in each direction, filling the blocks
+   // in between with their colors, then every half as many, and so on down to
+   // every pixel. Each pass traces only pixels that earlier passes didn't.
+   // After each pass but the last, progress(stride), if set, is called with
+   // the pass's stride, e.g. to display the image so far; if it returns
+   // false, the remaining passes are skipped, and trace() returns false.
+   unsigned progressive = 0;
+   std::function<bool(unsigned)> progress;
+
+   // For all methods: cancellation
+   // If cancel is set and *cancel becomes true, or if budget > 0 and budget
+   // seconds have passed since trace() began, then the threads stop tracing,
+   // each before its next row of pixels, and trace() returns false. Tiles of
+   // hzone x vzone that were finished are marked in image.done; the rest are
+   // left at image.background.
+   const std::atomic<bool> *cancel = nullptr;
+   double budget = 0;
+
+   // For uniform, bvh, and block, without antialiasing: reprojection
+   // If reproject > 0, then trace() remembers each pixel's hit. If the next
+   // trace(), into the same image and of the same model, differs only in that
+   // theta, phi, and roll have changed by at most reproject degrees, and d by
+   // at most a fraction reproject*pi/180 of itself, then the hits are warped
+   // into the new view and reshaded, and only the pixels that they don't cover,
+   // or that are at a shape's edge, are traced; progressive is then ignored.
+   // Approximate, and not just to within a pixel: a shape that was hidden in
+   // the last frame, and comes into view with the move, can be missed where
+   // hits on what's behind it, warped into the new view, are reused in its
+   // place, as only holes, and pixels at the edges of the last frame's hits,
+   // are retraced.
+   // Applies only to calls to trace() without a per-pixel array.
+   real reproject = 0;
+
+   // For uniform: incremental updates
+   // If incremental, and the only changes to the model since the last trace()
+   // are logged in model.changes (by modify(), push(), or erase()), then
+   // trace() re-bins only the changed shapes and retraces only the pixels
+   // around them; see model::changes. Off by default: with it on, shapes that
+   // are changed in place without modify() leave a stale image.
+   bool incremental = false;
+
    // For all methods: fudge factor, leaner memory use flag
    real fudge = default_fudge;
    bool lean  = true;
@@ -120,8 +180,9 @@ template<class real>
 inline void fix_engine(
    engine<real> &obj, const ulong hpixel, const ulong vpixel
 ) {
-   // uniform fix
-   if (obj.method == kip::method::uniform) {
+   // uniform fix; bvh and block, too, as they reuse hzone and vzone for
+   // their tiles
+   if (obj.method != kip::method::recursive) {
       // hzone, vzone
       fix_zone_hv(obj.hzone, hpixel);
       fix_zone_hv(obj.vzone, vpixel);
@@ -129,10 +190,19 @@ inline void fix_engine(
       // hsub, vsub
       fix_sub_hv(obj.hsub, obj.hzone, hpixel);
       fix_sub_hv(obj.vsub, obj.vzone, vpixel);
+
+      // leaf_size (bvh)
+      if (obj.leaf_size < 1)
+         obj.leaf_size = 1;
+
+      // xzone, yzone, zzone (block)
+      fix_zone_xyz(obj.xzone);
+      fix_zone_xyz(obj.yzone);
+      fix_zone_xyz(obj.zzone);
    }
 
    // recursive fix
-   else if (obj.method == kip::method::recursive) {
+   else {
       // hdivision
       if (obj.hdivision < 2)
          obj.hdivision = 2;
@@ -152,17 +222,20 @@ inline void fix_engine(
          obj.min_area = unsigned(hpixel*vpixel);
    }
 
-   // block fix
-   else {
-      // xzone, yzone, zzone
-      fix_zone_xyz(obj.xzone);
-      fix_zone_xyz(obj.yzone);
-      fix_zone_xyz(obj.zzone);
-   }
-
    // sort_frac, sort_min
    fix_sort(obj);
 
+   // progressive: 0, or a power of 2
+   if (obj.progressive < 2)
+      obj.progressive = 0;
+   else
+      while (obj.progressive & (obj.progressive-1))
+         obj.progressive &= obj.progressive-1;
+
+   // reproject
+   if (!(obj.reproject > 0))
+      obj.reproject = 0;
+
    // fudge factor
    // Definitely require fudge < 1, as a strict inequality. Allowing fudge == 1,
    // while feasible, would require greater care regarding strict vs. non-strict
@@ -52,6 +52,52 @@ public:
 
 
 
+// -----------------------------------------------------------------------------
+// rect
+// A region of an image: columns [imin,iend), rows [jmin,jend). For trace()s
+// that render just that region. With the uniform method, a shape's mend is
+// the region it covered in the last trace().
+// -----------------------------------------------------------------------------
+
+class rect {
+public:
+   ulong imin = 0, iend = 0;
+   ulong jmin = 0, jend = 0;
+
+   // rect()
+   explicit rect() { }
+
+   // rect(imin,iend, jmin,jend)
+   explicit rect(
+      const ulong _imin, const ulong _iend,
+      const ulong _jmin, const ulong _jend
+   ) :
+      imin(_imin), iend(_iend),
+      jmin(_jmin), jend(_jend)
+   { }
+
+   // rect(minend); not explicit, so that a shape's mend can be given as is
+   rect(const minend &m) :
+      imin(m.imin), iend(m.iend),
+      jmin(m.jmin), jend(m.jend)
+   { }
+
+   // empty
+   bool empty() const { return imin >= iend || jmin >= jend; }
+
+   // grow: to include r, e.g. a shape's region before and after it changes
+   rect &grow(const rect &r)
+   {
+      if (r.empty()) return *this;
+      if (empty()) return *this = r;
+      imin = op::min(imin,r.imin);  iend = op::max(iend,r.iend);
+      jmin = op::min(jmin,r.jmin);  jend = op::max(jend,r.jend);
+      return *this;
+   }
+};
+
+
+
 // -----------------------------------------------------------------------------
 // image
 // -----------------------------------------------------------------------------
@@ -87,6 +133,19 @@ public:
    mutable unsigned anti;  // antialiasing indicator
    mutable detail::border_t border;  // bin/object border information
 
+   // adaptive antialiasing
+   // If adaptive, and anti > 1, then each pixel is first traced with one ray,
+   // and only those whose color differs from one of their neighbors' by more
+   // than contrast, in r, g, or b, are then antialiased.
+   bool adaptive = false;
+   unsigned contrast = 16;
+
+   // done
+   // After trace(), done(i,j) != 0 iff tile (i,j), of engine.hzone x
+   // engine.vzone, was finished, i.e. wasn't cut off by engine.cancel or
+   // engine.budget. For the recursive method, it's all or nothing.
+   array<2,uchar> done;
+
    // prior zzz Eventually make private, so users can't disturb
    class _prior {
    public:
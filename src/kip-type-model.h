@@ -9,19 +9,86 @@ template<
 >
 class model {
    // copy constructor/assignment; deliberately private
-   model(const model &) : append(false) { }
+   model(const model &) : append(false), revision(0) { }
    model &operator=(const model &) { return *this; }
 
 public:
 
    // Data
-   #ifdef KIP_BLOCK
-      kip::bbox<real> bbox;
-   #endif
    bool append;
 
+   // revision
+   // Incremented by push(), modify(), erase(), clear(), and assign(). If you
+   // modify existing shapes in place, other than through modify(), increment
+   // it yourself; the bvh method keeps a per-model hierarchy, and rebuilds it
+   // only if this or the shape containers change.
+   ulong revision;
+
+   // changes
+   // The shapes that push(), modify(), and erase() have touched, in order,
+   // each with the revision that the change brought the model to, and with
+   // its screen rectangle (shape.mend) from before the change. If, between
+   // two trace()s with the uniform method and engine.incremental, the only
+   // changes to the model are logged here, and nothing else (view, light,
+   // image, etc.) has changed, then the second trace() re-bins only these
+   // shapes, and retraces only the pixels around where they were, or are; see
+   // trace_partial. Only the most recent max_changes are kept.
+   // With engine.incremental, changing shapes in place without modify() is
+   // unsafe: such changes aren't logged, and if others are, the second trace()
+   // doesn't retrace the unlogged ones' pixels. Change them through modify(),
+   // or turn incremental off.
+   class change {
+   public:
+      const shape<real,base> *ptr;
+      minend mend;
+      ulong revision;
+   };
+   static constexpr ulong max_changes = 4096;
+   std::vector<change> changes;
+
+   // traced: the renderer's vars, if the uniform method, in the last trace()
+   const void *traced = nullptr;
+
    // Constructor
-   explicit model() : append(false) { }
+   explicit model() : append(false), revision(0) { }
+
+private:
+
+   // log
+   void log(const shape<real,base> *const ptr, const minend &mend)
+   {
+      if (changes.size() == max_changes)
+         changes.erase(changes.begin(), changes.begin() + max_changes/2);
+      changes.push_back(change{ptr, mend, revision});
+   }
+
+public:
+
+   // modify(container, n)
+   // Returns container[n], to be changed in place, and logs the change; for
+   // example, model.modify(model.sphere, 12).r = 2. Call it again, after any
+   // trace() in between, for further changes.
+   template<class SHAPE>
+   SHAPE &modify(std::vector<SHAPE> &vec, const ulong n)
+   {
+      ++revision;
+      log(&vec[n], vec[n].mend);
+      return vec[n];
+   }
+
+   // erase(container, n)
+   // Removes container[n], by moving the container's last shape into its
+   // place, so that no other shape moves; logs both
+   template<class SHAPE>
+   void erase(std::vector<SHAPE> &vec, const ulong n)
+   {
+      ++revision;
+      log(&vec[n], vec[n].mend);
+      log(&vec.back(), vec.back().mend);
+      if (n+1 < vec.size())
+         vec[n] = std::move(vec.back());
+      vec.pop_back();
+   }
 
 
 
@@ -77,6 +144,8 @@ public:
       {\
          type.push_back(obj);\
          if (prop) type.back().propagate_base();\
+         ++revision;\
+         log(&type.back(), minend{0,0,0,0});\
          return type.back();\
       }\
       \
@@ -225,6 +294,21 @@ public:
    model &assign(const model &);
    ulong size() const;
 
+   // share(from)
+   // Like assign(), but the top-level surfs share from's nodes, tris, and
+   // hierarchies rather than copying them; see surf::share(). The result has
+   // its own per-view state, so it and from can be traced from different views
+   // at the same time. from must outlive this model, and mustn't change while
+   // this model is in use.
+   // Memory: only top-level surf geometry is shared. Each shape keeps its
+   // per-view state (pixel bounds, transformations, operators' operand
+   // workspace) in itself, so every other shape is copied in full, as with
+   // assign(); that includes each operator's whole operand tree, surfs in it
+   // too. So a copy of a model that's mostly primitives or operators costs
+   // about as much memory as the model itself, and the batched trace(model,
+   // views, ...) makes one such copy per thread.
+   model &share(const model &);
+
    // unbound
    void unbound();
 
@@ -513,6 +597,8 @@ void model<real,base>::clear()
 {
    const detail::functor_clear f;
    detail::allshape(*this, f);
+   ++revision;
+   changes.clear();
 }
 
 
@@ -525,6 +611,42 @@ model<real,base> &model<real,base>::assign(const model<real,base> &from)
    kip_expand(kip_make_assign,;)
 #undef  kip_make_assign
 
+   ++revision;
+   changes.clear();
+   return *this;
+}
+
+
+
+// share
+namespace detail {
+   template<class SHAPE>
+   void share(std::vector<SHAPE> &to, const std::vector<SHAPE> &from)
+   {
+      to = from;
+   }
+
+   template<class real, class base>
+   void share(
+      std::vector<surf<real,base>> &to,
+      const std::vector<surf<real,base>> &from
+   ) {
+      to.clear();
+      to.resize(from.size());
+      for (ulong n = 0;  n < from.size();  ++n)
+         to[n].share(from[n]);
+   }
+}
+
+template<class real, class base>
+model<real,base> &model<real,base>::share(const model<real,base> &from)
+{
+#define kip_make_share(type) detail::share(type, from.type)
+   kip_expand(kip_make_share,;)
+#undef  kip_make_share
+
+   ++revision;
+   changes.clear();
    return *this;
 }
 
@@ -746,7 +868,7 @@ bool read_shape(
       return false;
 
    // read keyword
-   static std::string word;
+   static thread_local std::string word;
    if (!read_value(k,word,description))
       return false;
 
@@ -811,6 +933,12 @@ bool read_shapes(kip::istream &k, NARY &obj)
 // i/o for model
 // -----------------------------------------------------------------------------
 
+// parallel_read (user-settable)
+// A model is read from a memory-mapped file, i.e. a kip::istream made from a
+// file name, in parallel, if at least this many bytes of the file remain;
+// 0 means never
+inline ulong parallel_read = 1ul << 20;
+
 namespace detail {
    // read_and_submit
    template<class real, class base>
@@ -829,11 +957,75 @@ namespace detail {
       template<class SHAPE>
       void fun()
       {
-         static SHAPE shape;
+         static thread_local SHAPE shape;
          if (k >> shape)
             model.push(shape);
       }
    };
+
+   // read_parallel
+   // Reads the rest of a mapped file's shapes, in parts, into a model per
+   // part, in parallel; then moves each part's shapes, in order, into the
+   // model. Returns false, having read nothing, if it can't, or if reading
+   // any part gave any diagnostic: errors, in particular, are then reported
+   // exactly as a serial read reports them, with recovery across parts, and
+   // with the error limit counted over the whole file.
+   template<class ISTREAM, class real, class base>
+   bool read_parallel(
+      ISTREAM &s, kip::model<real,base> &model,
+      const std::string &description
+   ) {
+      const int nthreads = get_nthreads();
+      if (nthreads < 2 || parallel_read == 0) return false;
+      const std::vector<kip::istream::part> part = s.split(4*ulong(nthreads));
+      if (part.size() < 2 || part.back().last - part[0].first < parallel_read)
+         return false;
+
+      // Lazily built tables that reading can reach: colors, and the base
+      // type's own, if any. Make them now, before the threads need them.
+      crayola_tables();
+      (void)base{};
+
+      const ulong npart = part.size();
+      std::vector<kip::model<real,base>> into(npart);
+      std::vector<std::unique_ptr<kip::istream>> from(npart);
+      std::vector<ulong> ndiag(npart,0);
+
+      #ifdef _OPENMP
+         #pragma omp parallel for num_threads(nthreads) schedule(dynamic)
+      #endif
+      for (ulong p = 0;  p < npart;  ++p) {
+         from[p].reset(new kip::istream(s,part[p]));
+         from[p]->maxerr = 1;  // we'll read serially anyway
+         diagnostics_held = &ndiag[p];
+         read_value(*from[p], into[p], description);
+         diagnostics_held = nullptr;
+      }
+      for (ulong p = 0;  p < npart;  ++p)
+         if (ndiag[p]) return false;
+
+      // move into model
+      #define kip_make_merge(type)\
+      {\
+         ulong total = model.type.size();\
+         for (ulong p = 0;  p < npart;  ++p)\
+            total += into[p].type.size();\
+         model.type.reserve(total);\
+         for (ulong p = 0;  p < npart;  ++p) {\
+            auto &vec = into[p].type;\
+            model.type.insert(model.type.end(),\
+               std::make_move_iterator(vec.begin()),\
+               std::make_move_iterator(vec.end()));\
+         }\
+      }
+      kip_expand(kip_make_merge,)
+      #undef kip_make_merge
+
+      s.resume(*from.back());
+      ++model.revision;
+      model.changes.clear();
+      return true;
+   }
 }
 
 
@@ -853,9 +1045,15 @@ bool read_value(
       note("Maximum number of errors = 0 is interpreted as no maximum");
    s.bail = false;
 
+   // read in parallel, if we can; see read_parallel()
+   if (detail::read_parallel(s, value, description)) {
+      s.clear();
+      return false;  // as below, on reaching end-of-file
+   }
+
    // read
    for (;;) {
-      static std::string word;
+      static thread_local std::string word;
       s.level = 0;
 
       // read keyword
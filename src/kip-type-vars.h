@@ -6,19 +6,197 @@
 
 namespace detail {
 
+// -----------------------------------------------------------------------------
+// bvh_prim
+// bvh_t
+// For the bvh method; bvh_node is in kip-misc-bvh.h
+// -----------------------------------------------------------------------------
+
+// bvh_prim
+// A top-level shape, with its bounding box
+template<class real, class tag>
+class bvh_prim {
+public:
+   kip::shape<real,tag> *shape;
+   point<real> min, max;  // bounding box, slightly padded
+   bool active;           // per-frame: processed, and possibly visible
+};
+
+// bvh_t
+template<class real, class tag>
+class bvh_t {
+public:
+   std::vector<bvh_prim<real,tag>> prim;       // bounded, in leaf order
+   std::vector<bvh_prim<real,tag>> unbounded;  // e.g. half; always examined
+   std::vector<bvh_node<real>> node;
+
+   // signature of the model from which the above were built
+   std::vector<std::pair<const void *, ulong>> signature;
+
+   // per-frame
+   u32 frame = 0;
+   std::vector<bvh_prim<real,tag> *> visible;
+};
+
+
+
+// -----------------------------------------------------------------------------
+// block_t
+// For the block method
+// -----------------------------------------------------------------------------
+
+// block_t
+// A uniform grid of nx*ny*nz cells over [min,max]. The prims overlapping cell
+// c = x + nx*(y + ny*z) are prim[index[n]] for n in [first[c],first[c+1]).
+template<class real, class tag>
+class block_t {
+public:
+   std::vector<bvh_prim<real,tag>> prim;       // bounded
+   std::vector<bvh_prim<real,tag>> unbounded;  // always examined
+   point<real> min, max, delta;                // grid bounds; cell size
+   unsigned nx = 0, ny = 0, nz = 0;
+   std::vector<u32> first, index;
+
+   // signature of the model, and grid size, from which the above were built
+   std::vector<std::pair<const void *, ulong>> signature;
+};
+
+
+
+// -----------------------------------------------------------------------------
+// rhit
+// reproject_t
+// For reprojection; see engine.reproject, and trace_reproject
+// -----------------------------------------------------------------------------
+
+// rhit
+// A pixel's hit, in world coordinates. Used as a per-pixel type, so set() is
+// called, via pixel_color(), with each pixel's nearest intersection. Floats
+// suffice, and keep the per-frame passes over these arrays short. shape is
+// what was hit, e.g. one of a surf's tris; top is the model's shape that it's
+// part of, or shape itself.
+template<class real, class tag>
+class rhit {
+public:
+   point<float> inter, normal;
+   const kip::shape<real,tag> *shape, *top;
+   const tag *color;
+   bool isnormalized;
+
+   void initialize() { shape = nullptr; }
+
+   void set(const inq<real,tag> &q)
+   {
+      shape = q.shape;
+      top   = q.top;
+      color = q.color;
+      isnormalized = q.isnormalized == normalized::yes;
+
+      // as in pixel_color(); back() matters only for eyelie shapes
+      const point<real> p = q.fac > 0 ? q.fac*q.inter : q.inter;
+      if (shape->eyelie) {
+         inter  = point<float>(shape->back(p));
+         normal = point<float>(
+            shape->back(q.n) - shape->back(point<real>(0,0,0)));
+      } else {
+         inter  = point<float>(p);
+         normal = point<float>(q.n);
+      }
+   }
+};
+
+// reproject_t
+// hit[now] receives this frame's hits. If valid, hit[!now] has the hits from
+// the last complete frame, which was of the image and view described below,
+// and of a model with the given signature (see hsignature).
+template<class real, class tag>
+class reproject_t {
+public:
+   array<2,rhit<real,tag>> hit[2];
+   unsigned now = 0;
+   bool valid = false;
+
+   const void *image = nullptr;
+   ulong hpixel = 0, vpixel = 0;
+   real aspect, fov, d, theta, phi, roll;
+   point<real> target;
+   std::vector<std::pair<const void *, ulong>> signature;
+
+   // scratch, for the warp: each pixel's nearest hit so far
+   array<2,real> depth;
+};
+
+
+
+// -----------------------------------------------------------------------------
+// uframe_t
+// For the uniform method: what the bins were made for, as of the last frame.
+// See trace_partial.
+// -----------------------------------------------------------------------------
+
+template<class real>
+class uframe_t {
+public:
+   bool valid = false;  // a complete frame, by the uniform method
+   const void *model = nullptr, *image = nullptr, *pixel = nullptr;
+   ulong revision = 0;
+   std::vector<const void *> data;  // the model's containers' data()
+   std::vector<real> param;         // view, light, engine, and image
+};
+
+
+
+// -----------------------------------------------------------------------------
+// window_t
+// For tiled rendering: the image being traced is a tile of a whole image of
+// hpixel x vpixel pixels, and begins at the whole image's pixel (i,j). See
+// trace_tiled().
+// -----------------------------------------------------------------------------
+
+class window_t {
+public:
+   bool on = false;
+   ulong hpixel = 0, vpixel = 0;
+   ulong i = 0, j = 0;
+};
+
+
+
+// vars
 template<class real, class tag>  // template arguments defaulted elsewhere
 class vars {
 public:
-   // Shapes: abstract access for uniform and block methods
+   // Shapes: abstract access for uniform method
    array<2,std::vector<minimum_and_ptr<real,shape<real,tag>>>> uniform;
-   array<3,vec_reset<real,tag>> block;
+
+   // Uniform method: each bin's cost, in seconds, last time; see utrace_helper
+   std::vector<double> ucost;
+
+   // Uniform method: bins for threads other than 0, which uses uniform, as
+   // shapes are processed; merged into uniform afterwards. See uprepare.
+   array<3,std::vector<minimum_and_ptr<real,shape<real,tag>>>> per_zone;
+
+   // Uniform method: if partial, then the bins are the last frame's, with
+   // just the shapes that the model logged as changed taken out and put back,
+   // and only the pixels in each bin's redo rectangle are traced. See
+   // model::changes, and trace_partial.
+   bool partial = false;
+   std::vector<minend> redo;
+   uframe_t<real> uframe;
+
+   // Shapes: hierarchy for bvh method, grid for block method
+   bvh_t<real,tag> bvh;
+   block_t<real,tag> block;
 
    // Miscellaneous
    rotate<3,real,op::full,op::unscaled> t2e;
    point<real> eyeball;
 
-   real hmax, hhalf,hfull, heps, hrat,hratsub;
-   real vmax, vhalf,vfull, veps, vrat,vratsub;
+   // The screen is [-hmax,hend] x [-vmax,vend]. It's symmetric, with hend ==
+   // hmax and vend == vmax, except for a tile; see window.
+   real hmax, hend, hhalf,hfull, heps, hrat,hratsub;
+   real vmax, vend, vhalf,vfull, veps, vrat,vratsub;
+   window_t window;
 
    rotate<3,real,op::part,op::unscaled> left, right;
    rotate<3,real,op::part,op::unscaled> bottom, top, behind;
@@ -30,6 +208,72 @@ public:
 
    unsigned anti2;
 
+   // Adaptive antialiasing: if adapt, then only the pixels (i,j) for which
+   // refine(i,j) != 0 are antialiased; the others keep their color from a
+   // first, one-ray-per-pixel pass. See image.adaptive, and trace_refine.
+   bool adapt = false;
+   array<2,uchar> refine;
+
+   // Progressive rendering: trace only the pixels (i,j) for which i and j are
+   // multiples of stride, but not both multiples of prior (if nonzero), which
+   // an earlier pass traced. Each is 0 or a power of 2. See engine.progressive.
+   u32 stride = 1, prior = 0;
+
+   bool skip(const u32 i, const u32 j) const
+   {
+      return ((i|j) & (stride-1)) || (prior && !((i|j) & (prior-1))) ||
+         (reusing && reuse(i,j)) || !inroi(i,j);
+   }
+
+   // whole: are all pixels traced?
+   bool whole() const
+      { return stride == 1 && prior == 0 && !reusing && !clip; }
+
+   // Region of interest: if clip, then only the pixels in roi are traced,
+   // and the rest of the image is left as it was. See trace(..., rect).
+   bool clip = false;
+   minend roi;
+
+   // inroi: is (i,j) in the region of interest, if there is one?
+   bool inroi(const u32 i, const u32 j) const
+   {
+      return !clip || (roi.imin <= i && i < roi.iend &&
+                       roi.jmin <= j && j < roi.jend);
+   }
+
+   // clip_roi: narrow [imin,iend) x [jmin,jend) to the region of interest, if
+   // there is one. Returns false if no pixels are left.
+   bool clip_roi(u32 &imin, u32 &iend, u32 &jmin, u32 &jend) const
+   {
+      if (clip) {
+         imin = op::max(imin, roi.imin);  iend = op::min(iend, roi.iend);
+         jmin = op::max(jmin, roi.jmin);  jend = op::min(jend, roi.jend);
+      }
+      return imin < iend && jmin < jend;
+   }
+
+   // Reprojection: if reusing, then the pixels (i,j) for which reuse(i,j) != 0
+   // have colors from the last frame's hits, warped into this view, and aren't
+   // traced. See engine.reproject, and trace_reproject.
+   bool reusing = false;
+   array<2,uchar> reuse;
+   reproject_t<real,tag> reproject;
+
+   // Cancellation: see engine.cancel and engine.budget. Once stop() returns
+   // true, it keeps doing so until trace() resets stopped.
+   const std::atomic<bool> *cancel = nullptr;
+   std::chrono::steady_clock::time_point deadline;
+   bool timed = false;
+   mutable std::atomic<bool> stopped{false};
+
+   bool stop() const
+   {
+      if (!stopped && ((cancel && *cancel) ||
+          (timed && std::chrono::steady_clock::now() >= deadline)))
+         stopped = true;
+      return stopped;
+   }
+
    // qqq figure out if we really need the crap below
    // anti-dependent constants
    // 1/anti in long double, double, and single
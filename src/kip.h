@@ -4,7 +4,6 @@
 // Users should #include only this file.
 
 // Defines
-//#define KIP_BLOCK  // zzz Faster without, and block.h is broken anyway
 
 //#define KIP_SEGMENTING_DIAG
 //#define KIP_SEGMENTING_QUAD
@@ -27,22 +26,50 @@
 
 // C++
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <charconv>
+#include <chrono>
 #include <cmath>
+#include <condition_variable>
+#include <cstddef>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <fstream>
+#include <functional>
+#include <future>
 #include <iomanip>
 #include <iostream>
 #include <limits>
 #include <list>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <new>
 #include <sstream>
+#include <thread>
 #include <vector>
 
+// POSIX, for memory-mapped reading, where we have it; see kip-io-stream.h.
+// Elsewhere, or if kip_no_mmap is defined, files are read with std::ifstream.
+#if !defined(kip_no_mmap) && (defined(__unix__) || defined(__APPLE__))
+#define kip_mmap
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// POSIX, for the render farm, which is opt-in; see kip-farm.h
+#ifdef kip_farm
+#include <cerrno>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#endif
+
 // OpenMP
 #ifdef _OPENMP
 #include <omp.h>
@@ -80,6 +107,9 @@ class ostream;
 #include "kip-misc-point.h"
 #include "kip-misc-array.h"
 #include "kip-misc-rotate.h"
+#include "kip-misc-bvh.h"
+#include "kip-misc-steal.h"
+#include "kip-misc-pool.h"
 
 #include "kip-color-rgb.h"
 #include "kip-color-crayola.h"
@@ -191,10 +221,16 @@ class ostream;
 // methods
 #include "kip-trace-uniform.h"
 #include "kip-trace-recursive.h"
+#include "kip-trace-bvh.h"
 #include "kip-trace-block.h"
 
 // api
 #include "kip-trace.h"
+#include "kip-io-write.h"
+#ifdef kip_farm
+#include "kip-farm.h"
+#endif
+#include "kip-io-binary.h"
 
 // ----------------
 // cleanup
@@ -208,5 +244,6 @@ class ostream;
 #undef  kip_description
 #undef  kip_expand
 #undef  kip_extra
+#undef  kip_mmap
 
 } // namespace kip